@@ -0,0 +1,327 @@
+/*  pwgen-bench - throughput and latency benchmarks for pwgen
+ *  Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "gensyms.h"
+#include "output.h"
+#include "pwgen.h"
+#include "random.h"
+
+#define PROGRAM_NAME "pwgen-bench"
+
+#define MAX_SAMPLES (1 << 20)   // latency samples kept per measurement
+#define LATENCY_BATCH 32        // passwords per latency sample
+#define OUTPUT_BATCH 100000     // passwords per engine_run in the output benchmark
+
+static volatile char sink;     // keeps the compiler from discarding the passwords
+
+enum format { text, csv, json };
+
+struct Bench { // benchmark settings and shared state
+	enum format format;
+	double seconds;              // time budget of every measurement
+	const RandomBackend *rng;
+	unsigned char key[RNG_KEY_BYTES];
+	double *samples;             // latency samples in nanoseconds
+	int rows;                    // number of results printed so far
+};
+
+struct Result { // outcome of one measurement
+	const char *test;        // which code path was measured
+	const char *set;         // name of the symbol set
+	size_t pool;             // number of symbols in the set
+	size_t len;              // password length
+	const char *kernel;      // kernel used by str_randomize
+	double chars_per_sec;
+	double passwords_per_sec;
+	double median_ns;        // median latency per password
+	double p99_ns;           // 99th percentile latency per password
+};
+
+static const size_t lengths[] = { 8, 16, 32, 64 };
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* Fill in the rates and latency percentiles of *res from n latency samples
+ * (each timing a batch of batch passwords), total passwords and elapsed
+ * nanoseconds. The latencies are averages over a batch, since timing every
+ * single password would mostly measure the clock.
+ */
+static void summarize(struct Result *res, double *samples, size_t n, size_t batch,
+                      double passwords, double elapsed)
+{
+	res->passwords_per_sec = passwords / elapsed * 1e9;
+	res->chars_per_sec = res->passwords_per_sec * res->len;
+
+	qsort(samples, n, sizeof(*samples), compare_doubles);
+	res->median_ns = samples[n / 2] / batch;
+	res->p99_ns = samples[(size_t)(n * 0.99)] / batch;
+}
+
+static void print_result(struct Bench *b, const struct Result *r)
+{
+	switch (b->format) {
+		case text:
+			if (b->rows == 0)
+				printf("%-13s %-9s %4s %4s %-7s %14s %14s %10s %10s\n", "test", "set", "pool", "len"
+				      , "kernel", "chars/s", "passwords/s", "median_ns", "p99_ns");
+			printf("%-13s %-9s %4zu %4zu %-7s %14.0f %14.0f %10.1f %10.1f\n", r->test, r->set, r->pool
+			      , r->len, r->kernel, r->chars_per_sec, r->passwords_per_sec, r->median_ns, r->p99_ns);
+			break;
+		case csv:
+			if (b->rows == 0)
+				printf("test,set,pool,len,kernel,rng,chars_per_sec,passwords_per_sec,median_ns,p99_ns\n");
+			printf("%s,%s,%zu,%zu,%s,%s,%.0f,%.0f,%.1f,%.1f\n", r->test, r->set, r->pool, r->len
+			      , r->kernel, b->rng->name, r->chars_per_sec, r->passwords_per_sec, r->median_ns, r->p99_ns);
+			break;
+		case json:
+			printf("%s\n  {\"test\": \"%s\", \"set\": \"%s\", \"pool\": %zu, \"len\": %zu, "
+			       "\"kernel\": \"%s\", \"rng\": \"%s\", \"chars_per_sec\": %.0f, "
+			       "\"passwords_per_sec\": %.0f, \"median_ns\": %.1f, \"p99_ns\": %.1f}"
+			      , b->rows == 0 ? "[" : ",", r->test, r->set, r->pool, r->len, r->kernel
+			      , b->rng->name, r->chars_per_sec, r->passwords_per_sec, r->median_ns, r->p99_ns);
+			break;
+	}
+	b->rows++;
+	fflush(stdout);
+}
+
+/* Build passwords out of single rand_lt() calls, one call per character.
+ */
+static void bench_rand_lt(struct Bench *b, const struct SymbolSet *set, size_t len)
+{
+	struct Result res = { "rand_lt", set->name, set->size, len, "-", 0, 0, 0, 0 };
+	struct RandomState rng;
+	char password[64];
+	size_t n = 0;
+	double passwords = 0;
+
+	rng_init(&rng, b->rng, b->key, 0);
+	double start = now_ns(), t = start;
+	while (t - start < b->seconds * 1e9 || n == 0) {
+		for (int k = 0; k < LATENCY_BATCH; ++k) {
+			for (size_t i = 0; i < len; ++i)
+				password[i] = set->data[rand_lt(&rng, set->size)];
+			sink = password[0];
+		}
+		double t1 = now_ns();
+		if (n < MAX_SAMPLES)
+			b->samples[n++] = t1 - t;
+		t = t1;
+		passwords += LATENCY_BATCH;
+	}
+	summarize(&res, b->samples, n, LATENCY_BATCH, passwords, t - start);
+	print_result(b, &res);
+}
+
+static void bench_str_randomize(struct Bench *b, const struct SymbolSet *set, size_t len, const struct Kernel *kernel)
+{
+	struct Result res = { "str_randomize", set->name, set->size, len, kernel->name, 0, 0, 0, 0 };
+	struct RandomState rng;
+	struct Sampler sampler;
+	char password[64];
+	size_t n = 0;
+	double passwords = 0;
+
+	sampler_init(&sampler, set->size);
+	sampler.kernel = kernel;
+	rng_init(&rng, b->rng, b->key, 0);
+	double start = now_ns(), t = start;
+	while (t - start < b->seconds * 1e9 || n == 0) {
+		for (int k = 0; k < LATENCY_BATCH; ++k) {
+			str_randomize(&rng, password, len, set->data, &sampler);
+			sink = password[0];
+		}
+		double t1 = now_ns();
+		if (n < MAX_SAMPLES)
+			b->samples[n++] = t1 - t;
+		t = t1;
+		passwords += LATENCY_BATCH;
+	}
+	summarize(&res, b->samples, n, LATENCY_BATCH, passwords, t - start);
+	print_result(b, &res);
+}
+
+/* Take passwords one at a time from the block of a library context.
+ */
+static void bench_next(struct Bench *b, const struct SymbolSet *set, size_t len)
+{
+	struct Result res = { "pwgen_next", set->name, set->size, len, "-", 0, 0, 0, 0 };
+	pwgen_ctx *ctx = pwgen_new();
+	char password[64 + 1];
+	size_t n = 0;
+	double passwords = 0;
+
+	if (!ctx || pwgen_add_set(ctx, set->name) != 0 || pwgen_set_rng(ctx, b->rng->name) != 0
+	    || pwgen_seed(ctx, b->key, sizeof(b->key)) != 0) {
+		perror(PROGRAM_NAME ": pwgen_new");
+		exit(EXIT_FAILURE);
+	}
+	double start = now_ns(), t = start;
+	while (t - start < b->seconds * 1e9 || n == 0) {
+		for (int k = 0; k < LATENCY_BATCH; ++k) {
+			pwgen_next(ctx, password, len);
+			sink = password[0];
+		}
+		double t1 = now_ns();
+		if (n < MAX_SAMPLES)
+			b->samples[n++] = t1 - t;
+		t = t1;
+		passwords += LATENCY_BATCH;
+	}
+	pwgen_free(ctx);
+	summarize(&res, b->samples, n, LATENCY_BATCH, passwords, t - start);
+	print_result(b, &res);
+}
+
+/* Run the whole generation engine, writing into /dev/null.
+ */
+static void bench_output(struct Bench *b, const struct SymbolSet *set, size_t len, int fd)
+{
+	struct Job job = { OUTPUT_BATCH, len, set->data, { 0, 0 }, b->rng, { 0 } };
+	struct Output out;
+	size_t n = 0;
+	double passwords = 0;
+
+	sampler_init(&job.sampler, set->size);
+	memcpy(job.key, b->key, sizeof(job.key));
+	struct Result res = { "output", set->name, set->size, len, job.sampler.kernel->name, 0, 0, 0, 0 };
+	if (output_init(&out, fd, 64 * 1024) != 0) {
+		fprintf(stderr, "%s: memory allocation failed\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+
+	double start = now_ns(), t = start;
+	while (t - start < b->seconds * 1e9 || n == 0) {
+		if (engine_run(&job, &out, 1) != 0) {
+			perror(PROGRAM_NAME ": output failed");
+			exit(EXIT_FAILURE);
+		}
+		double t1 = now_ns();
+		if (n < MAX_SAMPLES)
+			b->samples[n++] = t1 - t;
+		t = t1;
+		passwords += OUTPUT_BATCH;
+	}
+	output_close(&out);
+	summarize(&res, b->samples, n, OUTPUT_BATCH, passwords, t - start);
+	print_result(b, &res);
+}
+
+static void usage(void)
+{
+	printf("usage: %s [option ...]\n", PROGRAM_NAME);
+	printf("\noptions:\n");
+	printf("  -f <FMT>, --format=<FMT>  print results as text, csv or json (default: text)\n");
+	printf("  -t <S>, --time=<S>        spend <S> seconds on every measurement (default: 0.1)\n");
+	printf("  --rng=<NAME>              use the random number generator <NAME>\n");
+	printf("  -h, --help                print this message and exit\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct Bench b = { text, 0.1, &rng_chacha20, { 0 }, NULL, 0 };
+
+	struct option longopts[] = {
+		{ "format", required_argument, NULL, 'f' },
+		{ "time",   required_argument, NULL, 't' },
+		{ "rng",    required_argument, NULL, 'r' },
+		{ "help",   no_argument,       NULL, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+	int opt;
+	while ((opt = getopt_long(argc, argv, "f:t:h", longopts, NULL)) != -1) {
+		switch (opt) {
+			case 'f':
+				if (strcmp(optarg, "text") == 0)     b.format = text;
+				else if (strcmp(optarg, "csv") == 0)  b.format = csv;
+				else if (strcmp(optarg, "json") == 0) b.format = json;
+				else {
+					fprintf(stderr, "%s: unknown format: %s\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 't':
+				b.seconds = atof(optarg);
+				break;
+			case 'r':
+				b.rng = rng_backend_find(optarg);
+				if (!b.rng) {
+					fprintf(stderr, "%s: no such random number generator: %s\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'h':
+				usage();
+				exit(EXIT_SUCCESS);
+			default:
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	int fd = open("/dev/null", O_WRONLY);
+	b.samples = malloc(MAX_SAMPLES * sizeof(*b.samples));
+	if (fd < 0 || !b.samples) {
+		perror(PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < sizeof(b.key); ++i)  // a fixed key keeps runs comparable
+		b.key[i] = i;
+
+	for (const struct SymbolSet *set = predefined_sets; set->name; ++set) {
+		for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+			struct Sampler sampler;
+			sampler_init(&sampler, set->size);
+
+			bench_rand_lt(&b, set, lengths[l]);
+			bench_next(&b, set, lengths[l]);
+			for (const struct Kernel *const *k = kernels; *k; ++k) {
+				if ((*k)->available(&sampler))
+					bench_str_randomize(&b, set, lengths[l], *k);
+			}
+			bench_output(&b, set, lengths[l], fd);
+		}
+	}
+	if (b.format == json)
+		printf("\n]\n");
+	free(b.samples);
+	close(fd);
+
+	return EXIT_SUCCESS;
+}
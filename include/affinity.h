@@ -0,0 +1,55 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_AFFINITY_H
+#define PWGEN_AFFINITY_H
+
+/* Placement of the threads of the engine on the CPUs and NUMA nodes of the
+ * machine. The node of a CPU, and that of the device behind a file, are
+ * read from sysfs; a machine without that information is a single node.
+ */
+#define AFFINITY_MAX_CPUS 1024  // CPUs from 0 to AFFINITY_MAX_CPUS - 1 can be used
+
+typedef struct Affinity Affinity;
+struct Affinity { // where the generator threads and the writer run
+	int ncpus;                       // number of CPUs in cpus
+	int cpus[AFFINITY_MAX_CPUS];     // CPUs for the generator threads, in the order they are taken
+	int nodes[AFFINITY_MAX_CPUS];    // the node of each of them (0 unless numa)
+	int writer;                      // CPU for the writer thread, or -1 to leave it unpinned
+	int numa;                        // the threads of a node share its blocks, which are
+	                                 // allocated there (see engine.h)
+	unsigned char allowed[AFFINITY_MAX_CPUS / 8];  // CPUs the process could run on before
+};
+
+/* Fill in *aff for generator threads on the CPUs of the list cpulist (such
+ * as "0-3,8"), in that order, or on all CPUs the process may run on if
+ * cpulist is NULL. With numa, the CPUs are put in order node by node,
+ * starting from the node of the device that holds the file open at fd
+ * (or, for a pipe, a socket or a terminal, the node of the first CPU),
+ * so that the first threads share that node with the writer, which is
+ * pinned to the last CPU of the node.
+ *
+ * Return 0 on success, or -1 on error: EINVAL if cpulist is malformed or
+ * names a CPU the process may not run on, or an errno of sched_getaffinity.
+ */
+int affinity_init(struct Affinity *aff, const char *cpulist, int numa, int fd);
+
+/* Pin the calling thread to cpu. Return 0 on success, or -1 on error (errno
+ * is set).
+ */
+int affinity_pin(int cpu);
+
+/* Let the calling thread run on all the CPUs the process could run on when
+ * *aff was made, undoing affinity_pin.
+ */
+void affinity_unpin(const struct Affinity *aff);
+
+#endif
@@ -0,0 +1,48 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_BUFFER_H
+#define PWGEN_BUFFER_H
+
+#include <stddef.h>
+
+/* Reusable buffers for the records of the engine and the output. Every
+ * thread keeps the buffers it has given back in a pool of its own, so that
+ * a thread that generates batch after batch (such as a connection of the
+ * server, or repeated engine_run calls) allocates nothing once it has the
+ * buffers it needs, and no locking is needed. The buffers hold passwords,
+ * so they are wiped when they are given back, in bulk rather than record
+ * by record, and again before their memory is released.
+ */
+#define BUFFER_POOL_KEEP 64  // free buffers a thread keeps for reuse
+
+/* Return a buffer of at least size bytes from the pool of the calling
+ * thread, or a newly allocated one if the pool has none that large.
+ * The contents are zero. Return NULL if the allocation failed.
+ */
+void *buffer_get(size_t size);
+
+/* Wipe the buffer buf (from buffer_get) and give it back to the pool of the
+ * calling thread, or free it if the pool is full. Does nothing if buf is NULL.
+ */
+void buffer_put(void *buf);
+
+/* Wipe and free the buffers in the pool of the calling thread; call this
+ * before the thread exits, or the memory is lost.
+ */
+void buffer_release(void);
+
+/* Overwrite len bytes at p with zeros, in a way the compiler may not omit
+ * even though the memory is about to be freed or reused.
+ */
+void buffer_wipe(void *p, size_t len);
+
+#endif
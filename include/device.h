@@ -0,0 +1,69 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_DEVICE_H
+#define PWGEN_DEVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "random.h"
+
+/* Offload of password generation to an OpenCL device (normally a GPU), for
+ * very large runs. Like the statistics counters, it is compiled out unless
+ * OPENCL is defined (see the opencl target of the Makefile); the OpenCL
+ * library is then loaded at run time, so the build needs no OpenCL headers
+ * and the program still runs on machines without it.
+ *
+ * On the device every password is drawn by a work item of its own, from
+ * ChaCha20 keyed by a key derived from the master key, with the number of
+ * the password as the nonce: the generator is counter-based, so the work
+ * items need no state from each other. The symbols are drawn from the
+ * lookup table of the pool exactly as by the scalar kernel (rejecting the
+ * words below the threshold of the sampler), so the passwords have the
+ * same distribution as on the CPU, though not the same values.
+ */
+#ifdef OPENCL
+#  define OPENCL 1
+#else
+#  define OPENCL 0
+#endif
+
+#define DEVICE_BUFFER_SIZE (16 * 1024 * 1024)  // least bytes per block sent to the device
+
+typedef struct Device Device;
+
+/* Set up the first GPU (or other accelerator) found for generating records
+ * of reclen bytes, each of pwlen symbols drawn by sampler (which may not use
+ * an alias table) from symbols and followed by terminator if reclen >
+ * pwlen, at most max_records at a time. The device key is derived from the
+ * RNG_KEY_BYTES bytes of key.
+ *
+ * Return the device, or NULL with errno set: to ENOSYS if the program was
+ * built without OpenCL, to ENODEV if there is no OpenCL library or device,
+ * to EINVAL if the sampler uses an alias table, or to EIO if the device
+ * failed to set up.
+ */
+struct Device *device_open(const unsigned char *key, const char *symbols, const struct Sampler *sampler,
+                           size_t pwlen, size_t reclen, char terminator, size_t max_records);
+
+/* Generate count (at most max_records) records into buf, starting from
+ * record number index of the run. Safe to call from several threads; the
+ * calls take turns on the device. Return 0 on success, or -1 with errno
+ * set to EIO if the device failed.
+ */
+int device_fill(struct Device *device, char *buf, uint64_t index, size_t count);
+
+/* Release the device and everything allocated on it.
+ */
+void device_close(struct Device *device);
+
+#endif
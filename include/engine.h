@@ -0,0 +1,119 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_ENGINE_H
+#define PWGEN_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "affinity.h"
+#include "device.h"
+#include "format.h"
+#include "output.h"
+#include "pattern.h"
+#include "policy.h"
+#include "random.h"
+#include "unique.h"
+
+#define ENGINE_GROUP_RECORDS 256  // passwords per stream in the indexed mode
+
+typedef struct Job Job;
+struct Job { // description of a batch of passwords to generate
+	uint64_t pwcount;          // how many passwords to generate, or 0 for no limit
+	size_t pwlen;              // the length of each password
+	const char *symbols;       // pool of symbols the passwords are made of
+	struct Sampler sampler;    // draws indices into the pool of symbols
+	const struct RandomBackend *rng;     // algorithm of the random number generators
+	unsigned char key[RNG_KEY_BYTES];    // master seed of the random number generators
+	enum record_format format; // layout of the records (see format.h)
+	uint64_t first;            // number of the first password within the whole run,
+	                           // when this job is a shard of it (indexed mode only)
+	int indexed;               // draw every password from the stream of its group
+	struct UniqueSet *unique;  // if not NULL, passwords already in it are drawn again
+	const struct Pattern *pattern;  // if not NULL, the passwords are drawn from the classes
+	                           // of its positions instead of symbols (not with format_packed)
+	const struct Policy *policy;    // if not NULL, symbols every password must contain
+	                           // (not with format_packed or a pattern)
+	struct Device *device;     // if not NULL, the blocks are generated on it (but
+	                           // not in the indexed mode)
+	const struct Affinity *affinity;  // if not NULL, the CPUs of the threads (with
+	                           // more than one thread)
+};
+
+/* Generate the passwords described by *job and write them into *out, one
+ * record of job->format per password, using nthreads generator threads.
+ * Return 0 on success, or -1 if writing failed (errno is set by write) or
+ * if the threads could not be started (errno is set by pthread_create).
+ *
+ * Every thread owns a random number generator, seeded with job->key and the
+ * thread's number as its stream number, so that the threads draw from
+ * independent streams. The passwords are
+ * generated in blocks that fill out->size bytes (or hold a single password,
+ * if that is larger), and block number i is always generated by thread
+ * i % nthreads; hence the output only depends on the seed, the generator
+ * algorithm and nthreads.
+ * With nthreads == 1 all work is done in the calling thread. Otherwise the
+ * calling thread is one of the generators, and a dedicated writer thread
+ * drains the finished blocks in order from a lock-free ring, so that
+ * generation goes on while a write blocks; generators that get a full ring
+ * ahead of the writer wait for it.
+ *
+ * With job->affinity and more than one thread, every generator thread is
+ * pinned to a CPU of it, and the threads take the blocks of each other in
+ * turns instead of just their own, so that a thread slowed down by the
+ * others on its CPU leaves its blocks to the rest; every block is then
+ * drawn from a stream of its own, its number, so the output still depends
+ * only on the seed, the algorithm and the size of the blocks. With numa,
+ * only the threads of a node take the blocks of each other, the buffers of
+ * their slots are allocated by the first of them to use each, which puts
+ * the pages on that node, and the writer is pinned near the output device.
+ *
+ * With job->indexed the output does not even depend on nthreads or on the
+ * size of the blocks: password i of the run (counting from job->first) is
+ * drawn on its own from stream i / ENGINE_GROUP_RECORDS of job->key, after
+ * the passwords before it in that group, so it can be computed without
+ * generating the rest of the run. As the kernels consume random words
+ * differently, the sampler should use a kernel that is available on every
+ * CPU, such as kernel_batch, for the passwords to come out the same on
+ * every machine.
+ *
+ * With job->unique, every password is added to the set, and one that is
+ * already there is replaced by a new draw, so that no password comes out
+ * twice. Which of the threads gets to keep a password drawn by two of them
+ * depends on timing, so the unique mode is not combined with the indexed one.
+ *
+ * With job->device, the blocks are generated on the device from the number
+ * of their first password, and the generator threads only take turns
+ * handing them to it; duplicates of the unique mode, and the symbols of
+ * job->policy, are still drawn on the CPU. A block the device fails to
+ * generate is generated on the CPU instead.
+ *
+ * Either way, memory use is bounded by the blocks in flight, so that with
+ * job->pwcount == 0 the engine streams passwords until writing fails (e.g.
+ * with EPIPE once the reader of a pipe is gone).
+ */
+int engine_run(const struct Job *job, struct Output *out, int nthreads);
+
+/* Generate the passwords described by *job directly into map, which must
+ * hold job->pwcount (which must be positive) records of job->format, using
+ * nthreads threads.
+ * Return 0 on success, or -1 if the threads could not be started (errno is
+ * set by pthread_create); the threads that did start finish their blocks.
+ *
+ * Every thread writes its blocks of block_records records at their final
+ * offsets, so there is no writer and no copying. The blocks are assigned to
+ * the threads as in engine_run; with block_records == out->size divided by
+ * the record length, the result is the same as engine_run would have written.
+ */
+int engine_run_mapped(const struct Job *job, char *map, size_t block_records, int nthreads);
+
+#endif
@@ -0,0 +1,72 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_FORMAT_H
+#define PWGEN_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Output formats. Every format is a sequence of fixed-size records, one per
+ * password, so that the position of every record is known in advance.
+ *
+ * text:   the symbols followed by a newline (the default)
+ * nul:    the symbols followed by a '\0', e.g. for `xargs -0`
+ * raw:    the symbols only, with nothing in between the records
+ * packed: the indices of the symbols in the pool, FORMAT_PACKED_BITS(range)
+ *         bits each, packed starting from the least significant bit of every
+ *         byte; every record starts at a byte boundary. The records follow a
+ *         header that holds the pool (see format_header).
+ */
+enum record_format { format_text, format_nul, format_raw, format_packed };
+
+#define FORMAT_MAX_PACKED_RANGE 256  // the packed format indexes pools of up to 256 symbols
+#define FORMAT_MAX_HEADER_LEN (28 + FORMAT_MAX_PACKED_RANGE)  // longest possible header
+
+/* Find the format called name. Return 0 on success, or -1 if there is none.
+ */
+int format_find(const char *name, enum record_format *format);
+
+/* Return the name of format.
+ */
+const char *format_name(enum record_format format);
+
+/* Return the number of bits taken by a symbol index in the packed format for
+ * a pool of range symbols; a single symbol still takes one bit.
+ */
+unsigned format_packed_bits(uint32_t range);
+
+/* Return the size in bytes of one record of pwlen symbols from a pool of
+ * range symbols in the given format.
+ */
+size_t format_record_len(enum record_format format, size_t pwlen, uint32_t range);
+
+/* Return the size in bytes of the header that precedes the records, which
+ * is 0 for all formats but packed.
+ */
+size_t format_header_len(enum record_format format, uint32_t range);
+
+/* Write the header of format into buf, which must have room for
+ * format_header_len bytes. The packed header consists of, in order:
+ *
+ *   8 bytes    the magic string "PWGPACK1"
+ *   4 bytes    pwlen, the number of symbols in a record
+ *   4 bytes    range, the number of symbols in the pool
+ *   8 bytes    count, the number of records (0 if not known in advance)
+ *   4 bytes    bits, the width of every index
+ *   range bytes  the pool; index i stands for the symbol symbols[i]
+ *
+ * All numbers are unsigned little-endian integers.
+ */
+void format_header(enum record_format format, char *buf, size_t pwlen, uint64_t count,
+                   const char *symbols, uint32_t range);
+
+#endif
@@ -12,34 +12,48 @@
 #ifndef PWGEN_GENSYMS_H
 #define PWGEN_GENSYMS_H
 
-#include "llist.h"
+#include <stddef.h>
+#include <stdint.h>
 
-/* Initialize the predefined symbol sets.
- *
- * Note: the size variable of a node contains the number of characters in its
- * corresponding data string, excluding the terminating zero. That is,
- * strlen(n.data) == n.size, and the memory allocated for the data string is
- * equal to (size+1)*sizeof(char).
+typedef struct SymbolSet SymbolSet;
+struct SymbolSet { // a predefined symbol set
+	const char *name;  // user-facing name of this symbol set
+	const char *data;  // the symbols of the set
+	size_t size;       // number of characters in data (excluding '\0')
+};
+
+/* The predefined symbol sets, terminated by an entry whose name is NULL.
  *
- * The reason for all these dynamic allocations over static strings in the
- * program .text section is the desire to define them by ASCII character
- * ranges. This system also automates the string length calculations, which
- * should eliminate some pesky errors in case one modifies these character
- * sets.
+ * The sets are defined by ASCII character ranges in tools/mksymsets.c, which
+ * the build runs to generate this table as read-only data, along with a
+ * perfect hash of the set names. Using them costs no allocation or setup.
  */
-void init_symbol_sets(struct Node **llist_root);
+extern const struct SymbolSet predefined_sets[];
 
-/* Free the memory allocated for predefined symbol sets. They are only used
- * during the program setup, after which they may be freed.
+/* Return the predefined symbol set called name, or NULL if there is none.
+ * The lookup is a single probe of the generated perfect hash table.
  */
-void free_symbol_sets(struct Node **llist_root);
+const struct SymbolSet *symbol_set_find(const char *name);
 
-/* Replace characters from the start of the string dest with the ASCII values
- * between characters first and last (inclusive).
- * Return the number of characters replaced (i.e. #last - #first + 1).
- *
- * Make sure that dest has enough space to hold the characters.
+/* Parse a symbol set argument of the form NAME or NAME:WEIGHT, as taken by
+ * the -S option. Return the predefined set called NAME, or NULL if there is
+ * none. *weight is set to WEIGHT (1 if omitted), or to 0 if WEIGHT is not
+ * a positive integer of at most 32 bits.
  */
-size_t fill_ascii_range(char *dest, char first, char last);
+const struct SymbolSet *symbol_set_parse(const char *arg, uint32_t *weight);
+
+/* Hash function of the perfect hash table; mksymsets searches for a seed
+ * that maps all set names to distinct slots of a power-of-two table.
+ */
+static inline uint32_t symbol_set_hash(const char *name, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ seed;  // FNV-1a
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h ^ (h >> 16);
+}
 
 #endif
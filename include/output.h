@@ -0,0 +1,97 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_OUTPUT_H
+#define PWGEN_OUTPUT_H
+
+#include <stddef.h>
+
+#define OUTPUT_RING_BUFFERS 4  // buffers of an asynchronous output (see output_init_async)
+
+typedef struct Output Output;
+struct Output { // buffered writer for fixed-size output records
+	int fd;        // file descriptor the buffer is flushed into
+	char *buf;     // start of the contiguous output buffer
+	size_t size;   // capacity of the buffer in bytes
+	size_t used;   // number of bytes currently held in the buffer
+	struct OutputRing *ring;  // state of the asynchronous writes, or NULL
+};
+
+/* Prepare *out for writing into the file descriptor fd through a buffer of
+ * size bytes from the pool of the calling thread (see buffer.h). Return 0
+ * on success, or -1 if the buffer allocation failed.
+ *
+ * Records are laid out back to back in the buffer, and the whole buffer is
+ * written out with a single write(2) call once it cannot hold any more.
+ * This bypasses stdio, so do not mix output_* calls and stdio on the same fd.
+ */
+int output_init(struct Output *out, int fd, size_t size);
+
+/* Like output_init, but write through io_uring where the kernel allows it,
+ * falling back to plain write(2) calls otherwise. Then a full buffer is
+ * submitted to the kernel without waiting for it to be written, and the
+ * records go on into the next one of OUTPUT_RING_BUFFERS buffers, which are
+ * registered with the kernel as fixed buffers if the locked memory limit
+ * allows. Several writes are in flight into a regular file, each at its own
+ * offset; into a pipe, socket or a file open for appending, which take the
+ * data in order, one write is in flight while the next buffer fills.
+ *
+ * An error of an asynchronous write is reported by a later call, at the
+ * latest by output_flush or output_close, which wait for all writes.
+ */
+int output_init_async(struct Output *out, int fd, size_t size);
+
+/* Return a pointer to len bytes of free space at the end of the buffer,
+ * flushing the buffered records first if there is not enough room left.
+ * The caller must fill all len bytes, since they are counted as used.
+ *
+ * Return NULL if flushing failed (errno is set by write). Note that len may
+ * not exceed out->size.
+ */
+char *output_reserve(struct Output *out, size_t len);
+
+/* Write all buffered bytes into out->fd, retrying on partial writes and
+ * interrupts, and wait for any asynchronous writes to finish. Return 0 on
+ * success, or -1 on error (errno is set by write).
+ */
+int output_flush(struct Output *out);
+
+/* Write len bytes from data into out->fd, after first flushing the buffered
+ * records so that the output stays in order. This lets callers that build
+ * whole blocks of records in their own memory skip the copy into out->buf.
+ * An asynchronous output copies the data into its buffers instead, so that
+ * data may be reused as soon as the call returns.
+ * Return 0 on success, or -1 on error (errno is set by write).
+ */
+int output_write(struct Output *out, const char *data, size_t len);
+
+/* Flush the remaining buffered bytes, and wipe the buffers and give them
+ * back to the pool of the calling thread (see buffer.h), even if the flush
+ * failed. The one exception are the buffers of asynchronous writes that
+ * could not be waited for, which the kernel may still be reading: they are
+ * left allocated. Return the result of the final flush.
+ */
+int output_close(struct Output *out);
+
+/* Resize the file open for reading and writing at fd to exactly len bytes,
+ * and map it into memory, so that the records can be generated straight
+ * into the file without any writes or copies. Return the mapping, or NULL
+ * if resizing or mapping failed (errno is set). The data reaches the file
+ * as the kernel writes back the pages, at the latest on output_unmap.
+ */
+char *output_map(int fd, size_t len);
+
+/* Release the mapping of len bytes at map made by output_map. Return 0 on
+ * success, or -1 on error (errno is set by munmap).
+ */
+int output_unmap(char *map, size_t len);
+
+#endif
@@ -0,0 +1,73 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_PATTERN_H
+#define PWGEN_PATTERN_H
+
+#include <stddef.h>
+
+#include "random.h"
+
+/* A pattern gives every position of a password a class of its own, e.g.
+ * "Aaaa-9999-pppp" for four letters, four digits and four punctuation
+ * characters separated by dashes. In the source of a pattern,
+ *
+ *   A, a, 9, p   stand for the predefined sets ALPHA, alpha, num and punct,
+ *   {NAME}       stands for the predefined set NAME (see gensyms.h),
+ *   \c           stands for the character c itself, and
+ *   any other character stands for itself.
+ *
+ * The pattern is compiled once into a table of the symbols and sampler of
+ * every position, so drawing a password is a single pass over the table,
+ * and every password fits the pattern; nothing is drawn and thrown away
+ * for not matching it. A literal has no entropy, so it is copied without
+ * drawing, and takes no random words.
+ */
+
+struct PatternPosition { // what one position of the password is drawn from
+	const char *symbols;      // symbols of the class (a single one for a literal)
+	struct Sampler sampler;   // draws an index into symbols (range 1 for a literal,
+	                          // which is copied instead)
+};
+
+typedef struct Pattern Pattern;
+struct Pattern {
+	size_t len;                     // length of the passwords
+	struct PatternPosition *pos;    // len positions
+	char *literals;                 // storage of the literal characters
+};
+
+/* Compile the pattern source src into *pattern. Return 0 on success, or -1
+ * with errno set to EINVAL if src is empty or invalid (an unknown set name
+ * or an unterminated {, or a trailing \), or to ENOMEM.
+ */
+int pattern_compile(struct Pattern *pattern, const char *src);
+
+/* Release the memory held by *pattern.
+ */
+void pattern_free(struct Pattern *pattern);
+
+/* Overwrite the first pattern->len characters of str with a random password
+ * of the pattern, drawn from *rng.
+ */
+static inline void pattern_randomize(struct RandomState *rng, char *str, const struct Pattern *pattern)
+{
+	const struct PatternPosition *pos = pattern->pos;
+
+	for (size_t i = 0; i < pattern->len; ++i) {
+		if (pos[i].sampler.range == 1)  // a literal (or a set of one symbol)
+			str[i] = pos[i].symbols[0];
+		else
+			str[i] = pos[i].symbols[sampler_draw(&pos[i].sampler, rng)];
+	}
+}
+
+#endif
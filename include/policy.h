@@ -0,0 +1,72 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_POLICY_H
+#define PWGEN_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "random.h"
+
+/* A policy requires every password to contain at least a given number of
+ * symbols of some predefined sets, e.g. one digit and one punctuation
+ * character. Compliant passwords are built directly rather than filtered:
+ * the required symbols are drawn from their sets, and shuffled into a
+ * password of symbols drawn from the pool as usual.
+ */
+#define POLICY_MAX_SYMBOLS 64  // required symbols per password, of all sets together
+
+struct PolicySlot { // one required symbol, and the range of its position
+	const char *symbols;  // the set the symbol is drawn from
+	uint32_t size;        // number of symbols in the set
+	uint32_t bound;       // the position is drawn from [0, bound - 1]
+	uint32_t threshold;   // 2^32 mod (size * bound), the rejected zone of a draw
+};
+
+typedef struct Policy Policy;
+struct Policy {
+	struct PolicySlot slots[POLICY_MAX_SYMBOLS];
+	size_t required;      // number of slots in use
+};
+
+/* Add the requirements of spec, a comma-separated list of NAME[:COUNT]
+ * items (e.g. "num:1,punct:2") where NAME is a predefined set and COUNT
+ * defaults to 1, to *policy (which starts out zeroed). Return 0 on success,
+ * or -1 with errno set to EINVAL if an item is invalid or the policy would
+ * require more than POLICY_MAX_SYMBOLS symbols.
+ */
+int policy_add(struct Policy *policy, const char *spec);
+
+/* Prepare *policy for passwords of len symbols. Return 0 on success, or -1
+ * with errno set to EINVAL if it requires more than len symbols, or if len
+ * is too large.
+ */
+int policy_prepare(struct Policy *policy, size_t len);
+
+/* Turn the count records of reclen bytes at buf, each starting with len
+ * symbols drawn from the pool, into passwords that comply with *policy
+ * (prepared for len), drawing from *rng. The last policy->required symbols
+ * of a password are replaced with the required ones, which are then moved
+ * into random positions.
+ *
+ * The positions are picked by the last steps of an "inside-out"
+ * Fisher-Yates shuffle. Its first steps would only permute symbols that
+ * were drawn independently of each other from the same pool, which does
+ * not change their distribution, so they are skipped: the result is
+ * distributed as a full unbiased shuffle of the required symbols and the
+ * pool symbols. Every step draws its symbol and its position from a single
+ * random word, as two digits of a batched Lemire draw (see str_randomize).
+ */
+void policy_apply(const struct Policy *policy, struct RandomState *rng, char *buf,
+                  size_t count, size_t reclen, size_t len);
+
+#endif
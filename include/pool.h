@@ -0,0 +1,81 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_POOL_H
+#define PWGEN_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "random.h"
+
+#define POOL_MAX_LEN (1u << 24)  // largest lookup table pool_build will make
+#define POOL_ALIAS_LEN (1u << 16)  // pool_prepare uses an alias table beyond this
+
+typedef struct Pool Pool;
+struct Pool { // the pool of symbols that random strings are formed from
+	uint64_t counts[256];  // weight of every byte value in the pool
+	uint64_t total;        // sum of all weights
+	char *symbols;         // lookup table made by pool_build, zero-terminated
+	size_t len;            // number of characters in symbols (excluding '\0')
+};
+
+/* Initialize *pool as an empty pool. Return 0 (the pool allocates nothing
+ * until pool_build is called).
+ */
+int pool_init(struct Pool *pool);
+
+/* Add weight to every character of the zero-terminated string src, in a
+ * single pass over src. Repeated characters get the weight once for every
+ * occurrence, so that "aab" with weight 1 is the same as "a" with weight 2
+ * plus "b" with weight 1. Return 0 on success, or -1 with errno set to
+ * EINVAL if a weight would overflow (the pool is then left unchanged).
+ */
+int pool_add(struct Pool *pool, const char *src, uint64_t weight);
+
+/* Build pool->symbols, the lookup table of the pool: every character
+ * repeated in proportion to its weight, so that a uniformly random index
+ * into the table picks a character with the probability given by the
+ * weights. The weights are first divided by their greatest common divisor,
+ * which keeps the table as short as the weights allow; `-S ALPHA:2 -S
+ * alpha:2` needs no more room than `-S ALPHA -S alpha`.
+ *
+ * Return 0 on success, or -1 with errno set to EINVAL if the pool is empty
+ * or the table would exceed POOL_MAX_LEN characters, or to ENOMEM if memory
+ * allocation failed. The table may be rebuilt after further pool_add calls.
+ */
+int pool_build(struct Pool *pool);
+
+/* Set up *sampler for drawing from the pool, and make pool->symbols the
+ * symbols it draws from. If the lookup table of pool_build would be longer
+ * than max_table characters (normally POOL_ALIAS_LEN, at which point the
+ * pool has many duplicates), build
+ * *alias instead, and make pool->symbols the distinct symbols of the pool:
+ * the alias method then makes the cost of a symbol independent of the
+ * weights, and keeps the tables small enough to stay in the cache.
+ *
+ * Return 0 on success, or -1 with errno set as by pool_build (EINVAL is
+ * also returned if the weights are too large even for the alias table).
+ */
+int pool_prepare(struct Pool *pool, struct AliasTable *alias, struct Sampler *sampler, size_t max_table);
+
+/* Return the Shannon entropy of a symbol drawn from the (nonempty) pool in
+ * bits, -sum(p log2 p) over the distinct characters with their weighted
+ * probabilities p. Repeating a character thus adds no entropy, it only
+ * skews the pool.
+ */
+double pool_entropy(const struct Pool *pool);
+
+/* Release the memory held by *pool, and empty it.
+ */
+void pool_free(struct Pool *pool);
+
+#endif
@@ -0,0 +1,106 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_PWGEN_H
+#define PWGEN_PWGEN_H
+
+/* libpwgen - the password generator of pwgen as a library.
+ *
+ * All state lives in a caller-owned generator context; the library has no
+ * global state, so any number of contexts may be used concurrently, as long
+ * as every context is only used by one thread at a time.
+ *
+ * Functions that return int return 0 on success and -1 on failure, with
+ * errno set to EINVAL (bad argument) or ENOMEM (allocation failed).
+ */
+
+#include <stddef.h>
+
+typedef struct pwgen_ctx pwgen_ctx;
+
+/* Create a generator context with an empty symbol pool, using the ChaCha20
+ * generator seeded by the system (getrandom(2), or /dev/urandom). Return
+ * NULL on failure (errno is set).
+ *
+ * A context seeded by the system notices when it is used in a child
+ * process after fork(2), and draws a new seed, so that parent and child
+ * never generate the same passwords.
+ */
+pwgen_ctx *pwgen_new(void);
+
+/* Destroy the context ctx, wiping its generator state. ctx may be NULL.
+ */
+void pwgen_free(pwgen_ctx *ctx);
+
+/* Add the predefined symbol set called name (e.g. "alnum") to the pool.
+ * As with the -S option of the pwgen program, name may end in a weight,
+ * e.g. "ALPHA:2" counts every symbol of the set twice. Fails with EINVAL if
+ * there is no such set, or the weight is not valid.
+ */
+int pwgen_add_set(pwgen_ctx *ctx, const char *name);
+
+/* Add the characters of the zero-terminated string symbols to the pool.
+ * As with the pwgen program, repeated characters are more likely to be
+ * picked, and an empty pool means the predefined set "asciipns".
+ */
+int pwgen_add_symbols(pwgen_ctx *ctx, const char *symbols);
+
+/* Switch to the random number generator called name ("chacha20", "aes-ctr"
+ * or "xoshiro"). It goes on from the current seed with a stream of its own,
+ * one not used since the context was seeded, so the passwords that follow
+ * do not repeat those handed out before, even if name is the generator in
+ * use; a given seed and sequence of calls still gives the same passwords.
+ * Fails with EINVAL if the generator does not exist or is not supported on
+ * this CPU.
+ */
+int pwgen_set_rng(pwgen_ctx *ctx, const char *name);
+
+/* Reseed the generator with the first len bytes of key (at most 32 bytes are
+ * used; shorter keys are padded with zeros). The same seed, generator and
+ * pool always give the same passwords, also across fork(2).
+ */
+int pwgen_seed(pwgen_ctx *ctx, const void *key, size_t len);
+
+/* Write count random passwords of len characters into buf, each followed by
+ * a '\0', so that buf must have room for count*(len+1) characters. Fails
+ * with EINVAL if the weights of the pool are too uneven to sample.
+ */
+int pwgen_fill(pwgen_ctx *ctx, char *buf, size_t count, size_t len);
+
+/* Write one random password of len characters, followed by a '\0', into
+ * buf, which must have room for len+1 characters.
+ *
+ * The passwords come from a block that the context generates a few
+ * kilobytes at a time and refills when it runs out (or is asked for
+ * another length), so that most calls only copy a password out of memory
+ * that is already in the cache. The block is thrown away when the pool,
+ * the generator or the seed changes, and in the child process after
+ * fork(2) unless the context was seeded with pwgen_seed. Passwords from
+ * pwgen_fill do not come from the block.
+ */
+int pwgen_next(pwgen_ctx *ctx, char *buf, size_t len);
+
+/* A function given to pwgen_foreach, called with a '\0'-terminated password
+ * of len characters and the arg of pwgen_foreach. The password is only
+ * valid until the function returns or calls a function on the context.
+ * Should return 0 to go on, or any other value to stop.
+ */
+typedef int pwgen_callback(const char *password, size_t len, void *arg);
+
+/* Call cb with count random passwords of len characters in turn, straight
+ * from the block of pwgen_next (and continuing its sequence), so that no
+ * password is copied at all. cb may call the other functions on ctx.
+ * Return 0 once all count calls are made, the value cb returned if it was
+ * not 0, or -1 on failure as with pwgen_fill.
+ */
+int pwgen_foreach(pwgen_ctx *ctx, pwgen_callback *cb, void *arg, size_t count, size_t len);
+
+#endif
@@ -12,21 +12,265 @@
 #ifndef PWGEN_RANDOM_H
 #define PWGEN_RANDOM_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stats.h"
+
+#define RNG_KEY_BYTES 32    // size of the key (seed) of every generator backend
+#define RNG_BLOCK_WORDS 64  // number of 32-bit words generated per refill
+#define RNG_REKEY_REFILLS (UINT32_C(1) << 22)  // refills (1 GiB of output) between rekeys
+
+typedef struct RandomState RandomState;
+typedef struct RandomBackend RandomBackend;
+typedef struct Sampler Sampler;
+typedef struct Kernel Kernel;
+typedef struct AliasTable AliasTable;
+
+struct RandomBackend { // a pluggable algorithm for generating random words
+	const char *name;   // user-facing name of this generator
+	int (*available)(void);  // nonzero if the algorithm can run on this CPU
+	void (*init)(struct RandomState *rng, const unsigned char *key, uint64_t stream);
+	void (*refill)(struct RandomState *rng);  // overwrite rng->block
+};
+
+struct RandomState { // state of one pseudo-random number generator
+	const struct RandomBackend *backend;
+	union { // internal state of the backend
+		uint32_t chacha[16];   // ChaCha20 input block
+		struct {
+			uint32_t round_keys[60];  // AES-256 key schedule
+			uint64_t counter;
+			uint64_t stream;
+		} aes;
+		uint64_t xoshiro[4];   // xoshiro256** state
+	} u;
+	size_t pos;                        // index of the next unused word in block
+	uint32_t block[RNG_BLOCK_WORDS];   // buffered output of the backend
+	unsigned char key[RNG_KEY_BYTES];  // key derived for this generator
+	uint64_t stream;
+	uint32_t refills;                  // refills left until the next rekey
+};
+
+/* Available generator backends. ChaCha20 is the default; it is a
+ * cryptographically secure stream cipher that runs on any CPU. AES-CTR is
+ * AES-256 in counter mode, available on x86 CPUs with the AES-NI instruction
+ * set extension. Xoshiro256** is very fast, but not cryptographically secure.
+ */
+extern const struct RandomBackend rng_chacha20;
+extern const struct RandomBackend rng_aes_ctr;
+extern const struct RandomBackend rng_xoshiro;
+extern const struct RandomBackend *const rng_backends[];  // NULL-terminated list
+
+/* Find the backend named name. Return NULL if there is no such backend, or
+ * if the backend is not available on this CPU.
+ */
+const struct RandomBackend *rng_backend_find(const char *name);
+
+/* Derive the RNG_KEY_BYTES bytes of subkey number index from the master key
+ * (RNG_KEY_BYTES bytes as well), by running ChaCha20 keyed with master at a
+ * block counter that the generators themselves never reach. Subkeys of
+ * distinct indices are unrelated, and do not reveal the master key.
+ * subkey may be the same buffer as master.
+ */
+void rng_derive(const unsigned char *master, uint64_t index, unsigned char *subkey);
+
+/* Initialize the generator *rng to use backend, seeded with a key derived
+ * from the first RNG_KEY_BYTES bytes of the master key and the stream
+ * number. Distinct stream numbers with the same key give unrelated
+ * sequences of random numbers, e.g. one for every thread.
+ */
+void rng_init(struct RandomState *rng, const struct RandomBackend *backend,
+              const unsigned char *key, uint64_t stream);
+
+/* Refill the buffer of *rng with a new block of random words.
+ *
+ * Every RNG_REKEY_REFILLS refills the generator replaces its key with a
+ * subkey of itself and starts over, so that no key is used for more than
+ * a bounded amount of output, and a captured state does not reveal the
+ * output before the last rekey. Rekeying is deterministic: the same seed
+ * still gives the same sequence.
+ */
+void rng_refill(struct RandomState *rng);
+
+/* Overwrite the key and state of *rng with zeros.
+ */
+void rng_wipe(struct RandomState *rng);
+
+/* Return the next (uniformly distributed) 32-bit random number from *rng.
+ */
+static inline uint32_t rng_next(struct RandomState *rng)
+{
+	if (rng->pos == RNG_BLOCK_WORDS)
+		rng_refill(rng);
+	return rng->block[rng->pos++];
+}
+
+/* Return the next (uniformly distributed) 64-bit random number from *rng.
+ */
+static inline uint64_t rng_next64(struct RandomState *rng)
+{
+	uint64_t lo = rng_next(rng);
+	return (uint64_t)rng_next(rng) << 32 | lo;
+}
+
+/* Return a pointer to the next n (at most RNG_BLOCK_WORDS) consecutive random
+ * words of *rng, e.g. for loading them into a vector register. If fewer than
+ * n words are left in the buffer, they are skipped and the buffer refilled.
+ */
+static inline const uint32_t *rng_words(struct RandomState *rng, size_t n)
+{
+	if (RNG_BLOCK_WORDS - rng->pos < n)
+		rng_refill(rng);
+
+	const uint32_t *words = rng->block + rng->pos;
+	rng->pos += n;
+	return words;
+}
+
 /* Return a (uniformly distributed) random integer from the
- * interval [0, upper_bound - 1].
- * Note: upper_bound may not exceed RAND_MAX.
+ * interval [0, upper_bound - 1], drawn from *rng.
+ * Note: upper_bound must be positive.
  *
- * Remember to seed the RNG first!
+ * Remember to seed the RNG first! For drawing many numbers from the same
+ * interval, a Sampler is faster.
  */
-int rand_lt(int upper_bound);
+int rand_lt(struct RandomState *rng, int upper_bound);
+
+#define SAMPLER_MAX_BATCH 40  // 3^40 < 2^64 < 3^41
+
+struct Sampler { // precomputed state for drawing integers from [0, range - 1]
+	uint32_t range;      // number of possible results
+	uint32_t threshold;  // 2^32 mod range, the size of the rejected zone
+	int pow2;            // nonzero if range is a power of two (including 1)
+	unsigned bits;       // ceil(log2(range)), the number of bits in an index
+	unsigned batch;      // number of results extracted from one 64-bit word
+	uint64_t batch_threshold;  // 2^64 mod range^batch
+	const struct AliasTable *alias;  // weights of the symbols, or NULL if all are equal
+	const struct Kernel *kernel;  // implementation of str_randomize
+};
+
+/* Prepare *sampler for drawing uniformly distributed integers from the
+ * interval [0, range - 1]. Note: range must be positive.
+ *
+ * This does the only division needed, so that sampler_draw needs none.
+ * It also selects the fastest kernel for str_randomize that this CPU
+ * supports; call it once at startup, not in the hot path.
+ */
+void sampler_init(struct Sampler *sampler, uint32_t range);
+
+struct AliasTable { // weighted choice among up to 256 symbols by the alias method
+	uint64_t total;          // sum of the weights, the capacity of every bucket
+	uint64_t threshold;      // 2^(word_bits - bits) mod total, the rejected zone of a draw
+	unsigned bits;           // log2 of the number of buckets
+	unsigned word_bits;      // width of the random words drawn from, 32 or 64
+	uint64_t cut[256];       // bucket i keeps its own symbol below cut[i] ...
+	unsigned char alias[256];  // ... and gives the rest to symbol alias[i]
+};
+
+/* Build the alias table of n (at most 256) symbols with the given integer
+ * weights, by the integer version of Vose's algorithm. There are 2^bits
+ * buckets (the next power of two from n; the extra ones belong to symbols of
+ * weight 0). Return 0 on success, or -1 if 2^bits times the sum of the
+ * weights does not fit in 64 bits.
+ *
+ * A symbol is then drawn with two uniform numbers: a bucket i from
+ * [0, 2^bits - 1] and a position v from [0, total - 1]; the result is i if
+ * v < cut[i], and alias[i] otherwise. Every bucket holds an equal share of
+ * the probability, so the cost of drawing does not depend on the size of the
+ * weights, and the
+ * distribution is exactly the one given by them (see M. D. Vose, "A Linear
+ * Algorithm for Generating Random Numbers with a Given Distribution", 1991).
+ */
+int alias_init(struct AliasTable *table, const uint64_t *weights, uint32_t n);
+
+/* Prepare *sampler for drawing symbol indices from [0, n - 1] with the
+ * weights of *table, which must outlive the sampler. This selects the alias
+ * kernel, the only one that supports weights.
+ */
+void sampler_init_alias(struct Sampler *sampler, const struct AliasTable *table, uint32_t n);
+
+/* Return a (uniformly distributed) random integer from the interval
+ * [0, sampler->range - 1], drawn from *rng.
+ *
+ * The random word is scaled into the range by a multiplication, as in
+ * D. Lemire, "Fast Random Integer Generation in an Interval" (2019): the high
+ * half of the 64-bit product is the result, and products whose low half is
+ * below the threshold are rejected to keep the distribution exactly uniform.
+ */
+static inline uint32_t sampler_draw(const struct Sampler *sampler, struct RandomState *rng)
+{
+	uint64_t m = (uint64_t)rng_next(rng) * sampler->range;
+
+	while ((uint32_t)m < sampler->threshold) {
+		stats_add(stat_rejections, 1);
+		m = (uint64_t)rng_next(rng) * sampler->range;
+	}
+
+	return (uint32_t)(m >> 32);
+}
 
 /* Overwrite the first n characters of str with random characters from
- * the beginning (first len_symbols characters) of the symbols string.
+ * the beginning (first sampler->range characters) of the symbols string.
  *
  * The appearance of every character from symbols is equally likely; if a
  * character is repeated in symbols string, it is twice as likely to appear in
  * str, etc.
+ *
+ * The work is done by sampler->kernel (see below), which is by default the
+ * fastest one available. The batch kernel extracts several characters from
+ * every 64-bit random word: when the range is 2^k, by taking k bits at a
+ * time, and otherwise by scaling the word into the range sampler->batch
+ * times in a row (so that it is decoded as that many base-range digits).
+ * A batch of digits is rejected as a whole if the final remainder lies
+ * below sampler->batch_threshold, which keeps the joint distribution exactly
+ * uniform; see D. Lemire and N. Brackett-Rozinsky, "Batched Ranged Random
+ * Integer Generation" (2024).
+ */
+char *str_randomize(struct RandomState *rng, char *str, size_t len, const char *symbols, const struct Sampler *sampler);
+
+/* Fill buf with count consecutive records, each made of len random
+ * characters (as by str_randomize) followed by the terminator character.
+ * Return buf, which must have room for count*(len+1) characters.
+ *
+ * This is faster than calling str_randomize for every record, since the
+ * kernel runs only once over all count*len characters.
+ */
+char *records_randomize(struct RandomState *rng, char *buf, size_t count, size_t len, char terminator,
+                        const char *symbols, const struct Sampler *sampler);
+
+struct Kernel { // an implementation of str_randomize
+	const char *name;   // user-facing name of this kernel
+	int (*available)(const struct Sampler *sampler);  // nonzero if usable here
+	void (*randomize)(struct RandomState *rng, char *str, size_t len,
+	                  const char *symbols, const struct Sampler *sampler);
+};
+
+/* Available kernels. All of them produce exactly uniformly distributed
+ * symbols, but each consumes the random words differently.
+ *
+ * The alias kernel is the exception: it draws weighted symbols with the
+ * alias table of the sampler (see alias_init), and is only available for
+ * samplers made by sampler_init_alias.
+ *
+ * The scalar kernel draws one word per symbol with sampler_draw; it is the
+ * reference implementation. The batch kernel extracts several symbols from
+ * every word as described at str_randomize. The vector kernels (AVX2 on x86,
+ * NEON on AArch64) take ceil(log2(range)) bits from every random byte, reject
+ * the indices that fall out of range, and map the rest to symbols with
+ * byte shuffles, 32 (AVX2) or 16 (NEON) bytes at a time. They need a range
+ * of at most 128 symbols, which covers all the predefined symbol sets.
+ */
+extern const struct Kernel kernel_alias;
+extern const struct Kernel kernel_scalar;
+extern const struct Kernel kernel_batch;
+extern const struct Kernel kernel_avx2;
+extern const struct Kernel kernel_neon;
+extern const struct Kernel *const kernels[];  // NULL-terminated, fastest first
+
+/* Find the kernel named name. Return NULL if there is no such kernel, or if
+ * it is not available for *sampler on this CPU.
  */
-char *str_randomize(char *str, size_t len, const char *symbols, size_t len_symbols);
+const struct Kernel *kernel_find(const char *name, const struct Sampler *sampler);
 
 #endif
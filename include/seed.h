@@ -0,0 +1,28 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_SEED_H
+#define PWGEN_SEED_H
+
+#include <stddef.h>
+
+/* Fill the len bytes at buf with random bytes from the operating system.
+ * On Linux this is a single getrandom(2) call (repeated only for requests
+ * larger than the kernel hands out at once), with no file to open; elsewhere,
+ * or on kernels without getrandom, the bytes are read from /dev/urandom.
+ * Return 0 on success, or -1 with errno set.
+ *
+ * Draw one master seed this way and derive the keys of all generators from
+ * it, rather than asking the system for every generator (see rng_init).
+ */
+int seed_random(void *buf, size_t len);
+
+#endif
@@ -0,0 +1,74 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_SERVER_H
+#define PWGEN_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Wire protocol of the --serve/--client modes.
+ *
+ * The socket is a local UNIX stream socket, so all fields are in the native
+ * byte order of the host. A client may send any number of requests over one
+ * connection; each request is a struct Request followed by spec_len bytes of
+ * pool specification, and is answered by a struct Reply followed by length
+ * bytes of passwords (count records of pwlen symbols and a newline).
+ *
+ * The specification is a sequence of zero-terminated items, each starting
+ * with a type character: SPEC_SET followed by the name of a predefined
+ * symbol set, SPEC_SYMBOLS followed by literal symbols for the pool, or
+ * SPEC_RNG followed by the name of a random number generator. An empty pool
+ * means the default symbol set.
+ */
+#define REQUEST_MAGIC 0x31475750u  // "PWG1" read as little-endian
+#define REQUEST_MAX_SPEC (64 * 1024)
+#define REQUEST_MAX_PWLEN (1024 * 1024)
+
+#define SPEC_SET 'S'
+#define SPEC_SYMBOLS 'P'
+#define SPEC_RNG 'R'
+
+typedef struct Request Request;
+struct Request {
+	uint32_t magic;     // REQUEST_MAGIC
+	uint32_t pwlen;     // length of each password
+	uint64_t count;     // number of passwords
+	uint32_t spec_len;  // bytes of pool specification following the header
+	uint32_t reserved;  // zero
+};
+
+typedef struct Reply Reply;
+struct Reply {
+	uint32_t status;    // 0, or an errno value telling why the request failed
+	uint32_t reserved;  // zero
+	uint64_t length;    // bytes of passwords following the header
+};
+
+/* Serve password requests on a UNIX socket bound to path until an
+ * unrecoverable error occurs. Every connection gets its own thread, and the
+ * generator contexts of recently used specifications are kept for reuse, so
+ * that a request costs no reseeding or pool setup.
+ *
+ * A stale socket left at path by an earlier server is replaced. Return -1
+ * with errno set if the socket can not be set up or accepting fails.
+ */
+int server_run(const char *path);
+
+/* Request count passwords of pwlen symbols from the server listening at
+ * path, as specified by the spec_len bytes at spec, and copy the reply into
+ * the file descriptor fd. Return 0 on success, or -1 with errno set; a
+ * request refused by the server sets errno to the status in the reply.
+ */
+int client_request(const char *path, const char *spec, size_t spec_len,
+                   size_t pwlen, uint64_t count, int fd);
+
+#endif
@@ -0,0 +1,61 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_STATS_H
+#define PWGEN_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Counters of the hot paths, for the --stats report. Like debug_print, they
+ * are compiled out unless STATS is defined (see the stats target of the
+ * Makefile), so that the default build pays nothing for them.
+ */
+#ifdef STATS
+#  define STATS 1
+#else
+#  define STATS 0
+#endif
+
+enum stat_counter {
+	stat_rng_words,      // 32-bit words generated by the random number generators
+	stat_rejections,     // draws rejected to keep the distribution uniform (vector
+	                     // kernels count every rejected byte)
+	stat_bytes_written,  // bytes passed to write(2)
+	stat_writes,         // write(2) calls
+	stat_buffer_allocs,  // buffers allocated by buffer_get
+	stat_buffer_reuses,  // buffers buffer_get took from a pool instead
+	stat_setup_ns,       // wall-clock time before generation starts
+	stat_generate_ns,    // time spent generating blocks, summed over threads
+	stat_write_ns,       // time spent in write(2), summed over threads
+	stat_total_ns,       // wall-clock time of the whole run
+	stat_counters        // number of counters
+};
+
+extern uint64_t stats[stat_counters];
+
+/* Add n to counter; safe to call from any thread.
+ */
+#define stats_add(counter, n) do { \
+	if (STATS) \
+	__atomic_fetch_add(&stats[counter], (n), __ATOMIC_RELAXED); \
+} while (0)
+
+/* Return a monotonic time stamp in nanoseconds, or 0 if the counters are
+ * compiled out.
+ */
+uint64_t stats_clock(void);
+
+/* Print a summary of the counters into f.
+ */
+void stats_report(FILE *f);
+
+#endif
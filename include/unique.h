@@ -0,0 +1,91 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_UNIQUE_H
+#define PWGEN_UNIQUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A set of the records generated so far, for the --unique mode.
+ *
+ * The set keeps a 64-bit keyed fingerprint of every record in an
+ * open-addressing table with linear probing, at most UNIQUE_LOAD full, so it
+ * takes 8 to 16 bytes per record however long the records are. Slots are
+ * claimed with an atomic compare-and-swap, so any number of threads can
+ * insert at once without locking.
+ *
+ * Two different records with the same fingerprint count as duplicates. That
+ * costs a needless regeneration at worst (with odds of about 2^-64 per pair
+ * of records), but a record that did appear before is never let through.
+ */
+#define UNIQUE_LOAD 0.7  // largest fraction of the slots that may be used
+
+typedef struct UniqueSet UniqueSet;
+struct UniqueSet {
+	uint64_t *slots;       // fingerprints of the records; 0 marks an empty slot
+	uint64_t mask;         // number of slots minus 1 (a power of two minus 1)
+	uint64_t key;          // key of the fingerprint hash
+	uint64_t duplicates;   // insertions refused so far, updated atomically
+};
+
+/* Make *set empty, with room for capacity records, using key for the
+ * fingerprints. Return 0 on success, or -1 with errno set to ENOMEM.
+ */
+int unique_init(struct UniqueSet *set, uint64_t capacity, uint64_t key);
+
+/* Return the fingerprint of the len bytes of the record rec in *set.
+ */
+uint64_t unique_fingerprint(const struct UniqueSet *set, const char *rec, size_t len);
+
+/* Start loading the slot where the fingerprint h would go into the cache.
+ * A table of many records is mostly out of the cache, so fingerprinting a
+ * batch of records and prefetching their slots before inserting any of them
+ * overlaps the memory accesses.
+ */
+static inline void unique_prefetch(const struct UniqueSet *set, uint64_t h)
+{
+	__builtin_prefetch(&set->slots[h & set->mask], 1);
+}
+
+/* Add the record of fingerprint h to *set. Return 1 if the record was
+ * added, or 0 if it (or a record with the same fingerprint) already was in
+ * the set. No more than capacity records may be added.
+ */
+int unique_add(struct UniqueSet *set, uint64_t h);
+
+/* Add the len bytes of the record rec to *set, as unique_add.
+ */
+int unique_insert(struct UniqueSet *set, const char *rec, size_t len);
+
+/* Release the memory held by *set.
+ */
+void unique_free(struct UniqueSet *set);
+
+/* Return the probability that two independent strings of pwlen symbols
+ * drawn from a pool with the given weights of the 256 byte values (summing
+ * up to total) are equal: 1 / len_active_symbols^pwlen for a pool without
+ * weights.
+ */
+double unique_pool_odds(const uint64_t *counts, uint64_t total, size_t pwlen);
+
+/* Return the number of strings expected to be drawn again while drawing n
+ * unique strings, when two random strings are equal with probability q.
+ *
+ * The k-th string (from 0) collides with one of the strings before it with
+ * odds of about k*q, so it is drawn 1 / (1 - k*q) times on average, which
+ * accounts for the repeats of repeats as well. The sum of the repeats is
+ * exact for up to a million strings, and approximated by an integral (to
+ * well within a percent) beyond that; it is infinite if (n - 1)*q >= 1.
+ */
+double unique_expected_repeats(double q, uint64_t n);
+
+#endif
@@ -0,0 +1,68 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_URING_H
+#define PWGEN_URING_H
+
+#include <stddef.h>
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+/* A minimal io_uring instance driven by the raw system calls, so that no
+ * liburing is needed: a submission and a completion queue shared with the
+ * kernel, and the buffers registered with it.
+ */
+typedef struct Uring Uring;
+struct Uring {
+	int fd;                      // the io_uring, or -1
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_map, *cq_map;       // the mapped rings (the same if the kernel shares them)
+	size_t sq_map_len, cq_map_len, sqes_len;
+	unsigned pending;            // entries queued but not yet submitted
+};
+
+/* Set up *ring with room for entries submissions. Return 0 on success, or
+ * -1 with errno set (e.g. to ENOSYS or EPERM where io_uring is unavailable
+ * or forbidden).
+ */
+int uring_init(struct Uring *ring, unsigned entries);
+
+/* Register the n buffers of iov with the kernel, for IORING_OP_WRITE_FIXED.
+ * Return 0 on success, or -1 with errno set (e.g. to ENOMEM if they exceed
+ * the locked memory limit).
+ */
+int uring_register_buffers(struct Uring *ring, const struct iovec *iov, unsigned n);
+
+/* Return an empty submission entry to fill in, queued for the next
+ * uring_submit, or NULL if the submission queue is full.
+ */
+struct io_uring_sqe *uring_get_sqe(struct Uring *ring);
+
+/* Submit the queued entries, and wait until at least wait completions are
+ * available. Return 0 on success, or -1 with errno set.
+ */
+int uring_submit(struct Uring *ring, unsigned wait);
+
+/* Return the oldest unseen completion, or NULL if there is none yet. Call
+ * uring_seen once it has been handled.
+ */
+struct io_uring_cqe *uring_peek(struct Uring *ring);
+void uring_seen(struct Uring *ring);
+
+/* Tear down *ring.
+ */
+void uring_free(struct Uring *ring);
+
+#endif
@@ -0,0 +1,83 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PWGEN_WORDLIST_H
+#define PWGEN_WORDLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "output.h"
+#include "random.h"
+
+/* A word list is a text file of one word per line, such as a Diceware list.
+ * Empty lines are skipped, and so is everything up to the last tab of a
+ * line, so that lists numbered by dice rolls ("11111<TAB>abacus") work as
+ * they are.
+ *
+ * The list is memory-mapped and never copied: the words are found through
+ * an index of the offsets where they start, which is either built by one
+ * pass over the list or mapped from a sidecar file made earlier by
+ * wordlist_write_index (the name of the list with WORDLIST_INDEX_SUFFIX).
+ */
+#define WORDLIST_INDEX_SUFFIX ".idx"
+
+typedef struct Wordlist Wordlist;
+struct Wordlist {
+	const char *data;          // the mapped list
+	size_t size;               // bytes in the list
+	const uint32_t *offsets;   // offset of every word within data
+	uint32_t count;            // number of words
+	size_t longest;            // length of the longest word
+	void *index;               // the sidecar mapping, or the allocated offsets
+	size_t index_size;         // bytes of the sidecar mapping, or 0 if allocated
+};
+
+/* Map the word list at path into *list, with the index from its sidecar if
+ * that is there and up to date. Return 0 on success, or -1 with errno set:
+ * to EINVAL if the list has no words or is too large (4 GiB or more), or as
+ * set by open, fstat, mmap or malloc.
+ */
+int wordlist_open(struct Wordlist *list, const char *path);
+
+/* Write the index of *list into the sidecar of the list at path, so that
+ * later runs can map it instead of building it. Return 0 on success, or -1
+ * with errno set.
+ */
+int wordlist_write_index(const struct Wordlist *list, const char *path);
+
+/* Release the mappings and memory held by *list.
+ */
+void wordlist_close(struct Wordlist *list);
+
+/* Return the length of word number i of *list, and point *word to it.
+ */
+static inline size_t wordlist_word(const struct Wordlist *list, uint32_t i, const char **word)
+{
+	const char *start = list->data + list->offsets[i];
+	const char *end = start;
+	const char *limit = list->data + list->size;
+
+	while (end < limit && *end != '\n' && *end != '\r')
+		++end;
+	*word = start;
+	return end - start;
+}
+
+/* Write count passphrases into *out (or an endless stream, if count is 0),
+ * each of words words of *list drawn uniformly by *rng, joined by separator
+ * and followed by terminator. out->size must exceed list->longest. Return 0
+ * on success, or -1 if writing failed (errno is set by write).
+ */
+int wordlist_run(const struct Wordlist *list, struct RandomState *rng, size_t words,
+                 uint64_t count, char separator, char terminator, struct Output *out);
+
+#endif
@@ -13,8 +13,13 @@ demo_cmds=(
 	"${exe} --symbols=num"
 	"${exe} --count 10 --length=20 -Snum -- -+= .:"
 	"${exe} -l 50 -c 10 -S ALPHA -S ALPHA -S alpha  # 2/3rds uppercase, 1/3rd lowercase"
+	"${exe} -l 50 -c 10 -S ALPHA:2 -S alpha  # the same, with a weight"
 	"${exe} -l 10 -c 10 ________x  # One x per word (on average)"
+	"${exe} --stream -l 16 | head -n 3  # endless output, stops once head is done"
+	"${exe} -c 5 --pattern='Aaaa-9999-pppp'  # a class for every position"
+	"${exe} -c 5 -l 12 -S Alpha --require=num:1,punct:1  # compliant by construction"
 	"time ${exe} -l 11 -c 79000000 -r/dev/zero ' Hello' | grep 'Hello Hello'  # should take about 10 seconds"
+	"time ${exe} -l 11 -c 79000000 -r/dev/zero --threads=0 ' Hello' | grep 'Hello Hello'  # one thread per CPU"
 )
 
 set -e
@@ -1,3 +1,251 @@
-#!/bin/sh
+#!/bin/bash
 
-echo "::: NO TESTS TO RUN"
+# Usage: run-tests.sh EXE [PERF_EXE]
+#
+# Check the statistical quality and the reproducibility of the passwords
+# made by EXE (normally the sanitizer build), and if PERF_EXE (an optimized
+# build) is given, that its throughput has not dropped below the baseline
+# stored in tests/throughput.baseline. The checks of the library interface
+# are run too if pwgen-libcheck has been built next to EXE.
+#
+# The checksums of the reproducible mode in tests/seed-hex.sums and the
+# throughput baseline are rewritten from the current build, instead of being
+# checked, when UPDATE_BASELINE=1 is set in the environment; review the diff
+# before committing it.
+
+exe="${1}"
+perf_exe="${2}"
+testdir="$(dirname "${0}")/tests"
+sums="${testdir}/seed-hex.sums"
+baseline="${testdir}/throughput.baseline"
+
+chars=200000        # characters drawn for every uniformity test
+max_z=5             # uniformity tests fail beyond this many standard deviations
+tolerance=0.5       # throughput may drop to this fraction of the baseline (noise)
+
+failures=0
+tmp="$(mktemp -d)"
+trap 'rm -rf "${tmp}"' EXIT
+
+pass() { echo "::: pass: $*"; }
+fail() { echo "::: FAIL: $*"; failures=$((failures + 1)); }
+
+# Print the kernels available on this CPU for uniform pools.
+kernels() {
+	"${exe}" --kernel=help | awk 'NF == 1 { print $1 }'
+}
+
+# Print the symbols of a predefined set.
+set_symbols() {
+	"${exe}" -S help | awk -v name="${1}" '$1 == name' | cut -c13-
+}
+
+# Read "code weight" lines of the expected symbols from the file $1 and the
+# drawn bytes (from od) from stdin, and print the chi-square statistic of
+# the counts as a normal deviate (by the Wilson-Hilferty transformation),
+# or "stray" if a byte outside the expected symbols was drawn.
+chi_square() {
+	od -An -v -tu1 | awk -v expected="${1}" '
+		BEGIN {
+			while ((getline line < expected) > 0) {
+				split(line, f, " ")
+				weight[f[1]] = f[2]
+				total += f[2]
+				k++
+			}
+		}
+		{
+			for (i = 1; i <= NF; i++) {
+				if (!($i in weight)) { print "stray"; exit }
+				count[$i]++
+				n++
+			}
+		}
+		END {
+			if (n == 0) { print "stray"; exit }
+			for (c in weight) {
+				e = n * weight[c] / total
+				x += (count[c] - e) ^ 2 / e
+			}
+			df = k - 1
+			v = 2 / (9 * df)
+			printf "%.2f\n", ((x / df) ^ (1 / 3) - (1 - v)) / sqrt(v)
+		}'
+}
+
+# Check that the bytes from stdin are drawn from the symbols listed in the
+# expected file $1 with their weights; $2 names the test.
+check_uniform() {
+	local z
+	z="$(chi_square "${1}")"
+	if [ "${z}" = "stray" ]; then
+		fail "${2}: a symbol outside the pool was drawn"
+	elif awk -v z="${z}" -v max="${max_z}" 'BEGIN { exit !(z < -max || z > max) }'; then
+		fail "${2}: chi-square deviate ${z}"
+	else
+		pass "${2} (chi-square deviate ${z})"
+	fi
+}
+
+# Write "code 1" lines for the symbols of the string $1 into the file $2.
+uniform_weights() {
+	printf '%s' "${1}" | od -An -v -tu1 | tr -s ' ' '\n' | awk 'NF { print $1, 1 }' > "${2}"
+}
+
+if [ ! -x "${exe}" ]; then
+	echo "usage: ${0} EXE [PERF_EXE]" >&2
+	exit 1
+fi
+
+
+echo "::: uniformity of every predefined set with every kernel"
+"${exe}" -S help | awk '{ print $1 }' > "${tmp}/sets"
+while read -r set; do
+	uniform_weights "$(set_symbols "${set}")" "${tmp}/expected"
+	for kernel in $(kernels); do
+		"${exe}" -c 1 -l "${chars}" -S "${set}" --kernel="${kernel}" --format=raw \
+			| check_uniform "${tmp}/expected" "${set} (${kernel})"
+	done
+done < "${tmp}/sets"
+
+echo "::: uniformity of every random number generator"
+uniform_weights "$(set_symbols Alnum)" "${tmp}/expected"
+for rng in $("${exe}" --rng=help | awk '{ print $1 }'); do
+	"${exe}" -c 1 -l "${chars}" -S Alnum --rng="${rng}" --format=raw \
+		| check_uniform "${tmp}/expected" "Alnum (${rng})"
+done
+
+echo "::: weighted pools"
+# small weights go into a lookup table, large ones into an alias table
+for weights in "2 1" "7000 3001"; do
+	set -- ${weights}
+	{
+		uniform_weights "$(set_symbols num)" /dev/stdout | awk -v w="${1}" '{ print $1, w }'
+		uniform_weights "$(set_symbols alpha)" /dev/stdout | awk -v w="${2}" '{ print $1, w }'
+	} > "${tmp}/expected"
+	"${exe}" -c 1 -l "${chars}" -S "num:${1}" -S "alpha:${2}" --format=raw \
+		| check_uniform "${tmp}/expected" "num:${1} alpha:${2}"
+done
+
+echo "::: uniformity with --pattern and --require"
+uniform_weights "$(set_symbols punct)" "${tmp}/expected"
+"${exe}" -c $((chars / 4)) --pattern='{num}p{num}{alpha}' | cut -c2 | tr -d '\n' \
+	| check_uniform "${tmp}/expected" "punct position of a pattern"
+uniform_weights "$(set_symbols num)" "${tmp}/expected"
+"${exe}" -c $((chars / 8)) -l 8 -S alpha --require=num:1 | tr -dc '0-9' \
+	| check_uniform "${tmp}/expected" "required digits"
+"${exe}" -c $((chars / 8)) -l 8 -S alpha --require=num:1 \
+	| awk '{ match($0, /[0-9]/); printf "%d", RSTART - 1 }' > "${tmp}/positions"
+uniform_weights 01234567 "${tmp}/expected"
+check_uniform "${tmp}/expected" "positions of required digits" < "${tmp}/positions"
+
+echo "::: --unique with --require"
+# the distinct strings of the pool alone are no bound for those that comply
+for args in "-c 600 -l 2 -S alpha --require=num:1" "-c 20 -l 1 -S num --require=alpha:1"; do
+	timeout 10 "${exe}" ${args} --unique > /dev/null 2> "${tmp}/stderr"
+	if [ $? -ne 1 ]; then
+		fail "${args} --unique: not refused"
+	elif ! grep -q -- "--require" "${tmp}/stderr"; then
+		fail "${args} --unique: refused for another reason: $(cat "${tmp}/stderr")"
+	else
+		pass "${args} --unique is refused"
+	fi
+done
+
+echo "::: --wordlist with a stale index"
+# rewritten to the same size within the resolution of the file system clock,
+# so that the sidecar looks up to date but is not
+printf 'aa\nbb\n' > "${tmp}/words"
+"${exe}" --wordlist="${tmp}/words" --write-index
+printf 'aaaaa\n' > "${tmp}/words"
+touch -r "${tmp}/words.idx" "${tmp}/words"
+if ! "${exe}" --wordlist="${tmp}/words" -l 1 -c 100 --buffer-size=4 > "${tmp}/out" 2> "${tmp}/stderr"; then
+	fail "stale index: $(head -c 200 "${tmp}/stderr")"
+elif grep -qv '^\(aaaaa\|aa\)$' "${tmp}/out"; then
+	fail "stale index: words from outside the list"
+else
+	pass "a stale index does not overrun the output buffer"
+fi
+
+# built by "make test" next to EXE, from tests/libpwgen-check.c
+libcheck="$(dirname "${exe}")/pwgen-libcheck"
+if [ -x "${libcheck}" ]; then
+	echo "::: library interface"
+	"${libcheck}" > "${tmp}/libcheck"
+	status=$?
+	cat "${tmp}/libcheck"
+	failures=$((failures + $(grep -c '^::: FAIL' "${tmp}/libcheck")))
+	if [ ${status} -ne 0 ] && ! grep -q '^::: FAIL' "${tmp}/libcheck"; then
+		fail "${libcheck} exited with status ${status}"
+	fi
+fi
+
+echo "::: bit-exact reproducible mode"
+if [ "${UPDATE_BASELINE}" = 1 ]; then
+	while read -r sum size args; do
+		echo "$(eval "${exe} ${args}" | cksum) ${args}"
+	done < "${sums}" > "${tmp}/sums"
+	cp "${tmp}/sums" "${sums}"
+	echo "::: rewrote ${sums}"
+fi
+while read -r sum size args; do
+	if [ "$(eval "${exe} ${args}" | cksum)" = "${sum} ${size}" ]; then
+		pass "${args}"
+	else
+		fail "${args}: output changed"
+	fi
+done < "${sums}"
+
+key=000102030405060708090a0b0c0d0e0f
+seeded="${exe} --seed-hex=${key} -c 5000 -l 13"
+${seeded} > "${tmp}/whole"
+for variant in "--threads=3" "--threads=2 --buffer-size=100" "--output=${tmp}/mapped --mmap"; do
+	rm -f "${tmp}/mapped"
+	${seeded} ${variant} > "${tmp}/variant"
+	[ -f "${tmp}/mapped" ] && mv "${tmp}/mapped" "${tmp}/variant"
+	if cmp -s "${tmp}/whole" "${tmp}/variant"; then
+		pass "the same strings with ${variant%% *}"
+	else
+		fail "the strings change with ${variant}"
+	fi
+done
+for k in 1 2 3; do
+	${seeded} --shard=${k}/3
+done > "${tmp}/variant"
+if cmp -s "${tmp}/whole" "${tmp}/variant"; then
+	pass "the shards make up the whole run"
+else
+	fail "the shards do not make up the whole run"
+fi
+
+
+if [ -n "${perf_exe}" ]; then
+	echo "::: throughput of ${perf_exe}"
+	: > "${tmp}/baseline"
+	for kernel in $(kernels); do
+		start=$(date +%s%N)
+		"${perf_exe}" -c 2000000 -l 32 -S Alnum --kernel="${kernel}" --format=raw > /dev/null
+		end=$(date +%s%N)
+		mbps=$(awk -v ns=$((end - start)) 'BEGIN { printf "%.0f", 64e9 / ns }')
+		echo "${kernel} ${mbps}" >> "${tmp}/baseline"
+		base=$(awk -v k="${kernel}" '$1 == k { print $2 }' "${baseline}" 2>/dev/null)
+		if [ -z "${base}" ]; then
+			pass "${kernel}: ${mbps} MB/s (no baseline)"
+		elif awk -v m="${mbps}" -v b="${base}" -v t="${tolerance}" 'BEGIN { exit !(m < b * t) }'; then
+			fail "${kernel}: ${mbps} MB/s, baseline ${base} MB/s"
+		else
+			pass "${kernel}: ${mbps} MB/s (baseline ${base} MB/s)"
+		fi
+	done
+	if [ "${UPDATE_BASELINE}" = 1 ]; then
+		cp "${tmp}/baseline" "${baseline}"
+		echo "::: rewrote ${baseline}"
+	fi
+fi
+
+
+if [ "${failures}" -ne 0 ]; then
+	echo "::: ${failures} TESTS FAILED"
+	exit 1
+fi
+echo "::: ALL TESTS PASSED"
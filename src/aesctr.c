@@ -0,0 +1,139 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "debug.h"
+#include "random.h"
+
+/* AES-256 in counter mode, using the AES-NI instructions of x86 CPUs.
+ *
+ * The 128-bit counter block holds the block counter in its low 64 bits and
+ * the stream number in its high 64 bits. The code is compiled for the AES-NI
+ * target regardless of the compiler flags; rng_aes_ctr.available() checks at
+ * run time whether the CPU actually supports it.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <wmmintrin.h>
+
+#define AES_TARGET __attribute__((target("aes,sse2")))
+
+AES_TARGET static __m128i key_256_assist_1(__m128i t1, __m128i t2)
+{
+	__m128i t4;
+
+	t2 = _mm_shuffle_epi32(t2, 0xff);
+	t4 = _mm_slli_si128(t1, 4); t1 = _mm_xor_si128(t1, t4);
+	t4 = _mm_slli_si128(t4, 4); t1 = _mm_xor_si128(t1, t4);
+	t4 = _mm_slli_si128(t4, 4); t1 = _mm_xor_si128(t1, t4);
+	return _mm_xor_si128(t1, t2);
+}
+
+AES_TARGET static __m128i key_256_assist_2(__m128i t1, __m128i t3)
+{
+	__m128i t2, t4;
+
+	t4 = _mm_aeskeygenassist_si128(t1, 0x00);
+	t2 = _mm_shuffle_epi32(t4, 0xaa);
+	t4 = _mm_slli_si128(t3, 4); t3 = _mm_xor_si128(t3, t4);
+	t4 = _mm_slli_si128(t4, 4); t3 = _mm_xor_si128(t3, t4);
+	t4 = _mm_slli_si128(t4, 4); t3 = _mm_xor_si128(t3, t4);
+	return _mm_xor_si128(t3, t2);
+}
+
+// _mm_aeskeygenassist_si128 needs a compile-time constant round constant
+#define KEY_256_ROUND(i, rcon) do { \
+	t2 = _mm_aeskeygenassist_si128(t3, rcon); \
+	t1 = key_256_assist_1(t1, t2); rk[i] = t1; \
+	if (i < 14) { t3 = key_256_assist_2(t1, t3); rk[i + 1] = t3; } \
+} while (0)
+
+AES_TARGET static void aes_ctr_init(struct RandomState *rng, const unsigned char *key, uint64_t stream)
+{
+	__m128i rk[15];
+	__m128i t1 = _mm_loadu_si128((const __m128i *)key);
+	__m128i t2;
+	__m128i t3 = _mm_loadu_si128((const __m128i *)(key + 16));
+
+	rk[0] = t1;
+	rk[1] = t3;
+	KEY_256_ROUND( 2, 0x01);
+	KEY_256_ROUND( 4, 0x02);
+	KEY_256_ROUND( 6, 0x04);
+	KEY_256_ROUND( 8, 0x08);
+	KEY_256_ROUND(10, 0x10);
+	KEY_256_ROUND(12, 0x20);
+	KEY_256_ROUND(14, 0x40);
+
+	memcpy(rng->u.aes.round_keys, rk, sizeof(rk));
+	rng->u.aes.counter = 0;
+	rng->u.aes.stream = stream;
+}
+
+#define AES_PARALLEL 8  // blocks encrypted in an interleaved batch
+
+AES_TARGET static void aes_ctr_refill(struct RandomState *rng)
+{
+	const __m128i *rk = (const __m128i *)rng->u.aes.round_keys;
+	__m128i k[15];
+
+	for (int r = 0; r < 15; ++r)
+		k[r] = _mm_loadu_si128(rk + r);
+
+	for (size_t i = 0; i < RNG_BLOCK_WORDS; i += 4 * AES_PARALLEL) {
+		__m128i x[AES_PARALLEL];
+
+		for (int j = 0; j < AES_PARALLEL; ++j) {
+			uint64_t ctr = rng->u.aes.counter++;
+			x[j] = _mm_set_epi64x((long long)rng->u.aes.stream, (long long)ctr);
+			x[j] = _mm_xor_si128(x[j], k[0]);
+		}
+		for (int r = 1; r < 14; ++r) {
+			for (int j = 0; j < AES_PARALLEL; ++j)
+				x[j] = _mm_aesenc_si128(x[j], k[r]);
+		}
+		for (int j = 0; j < AES_PARALLEL; ++j) {
+			x[j] = _mm_aesenclast_si128(x[j], k[14]);
+			_mm_storeu_si128((__m128i *)(rng->block + i + 4 * j), x[j]);
+		}
+	}
+}
+
+static int aes_ctr_available(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("aes");
+}
+
+#else // no AES-NI on this platform
+
+static void aes_ctr_init(struct RandomState *rng, const unsigned char *key, uint64_t stream)
+{
+	(void)rng; (void)key; (void)stream;
+}
+
+static void aes_ctr_refill(struct RandomState *rng)
+{
+	(void)rng;
+}
+
+static int aes_ctr_available(void)
+{
+	return 0;
+}
+
+#endif
+
+const struct RandomBackend rng_aes_ctr = {
+	"aes-ctr", aes_ctr_available, aes_ctr_init, aes_ctr_refill
+};
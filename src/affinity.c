@@ -0,0 +1,203 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE  // cpu_set_t, pthread_setaffinity_np, major and minor
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "affinity.h"
+#include "debug.h"
+
+#define MAX_NODES 64  // NUMA nodes looked for in sysfs
+
+/* Append the CPUs of the list s ("0-3,8", as in sysfs and taskset) to the
+ * n CPUs at cpus, in the order they are listed. Return the new number of
+ * CPUs, or -1 if s is malformed or lists too many CPUs.
+ */
+static int parse_list(const char *s, int *cpus, int n)
+{
+	while (*s && *s != '\n') {
+		char *end;
+		if (!isdigit((unsigned char)*s))
+			return -1;
+		long first = strtol(s, &end, 10), last = first;
+		if (*end == '-') {
+			if (!isdigit((unsigned char)end[1]))
+				return -1;
+			last = strtol(end + 1, &end, 10);
+		}
+		if (last < first || last >= AFFINITY_MAX_CPUS || n + (last - first) >= AFFINITY_MAX_CPUS)
+			return -1;
+		for (long cpu = first; cpu <= last; ++cpu)
+			cpus[n++] = cpu;
+		if (*end == ',' && end[1])
+			++end;
+		else if (*end && *end != '\n')
+			return -1;
+		s = end;
+	}
+
+	return n;
+}
+
+/* Read the first line of the file at path into buf of len bytes. Return 0
+ * on success, or -1 if there is no such file.
+ */
+static int read_line(const char *path, char *buf, size_t len)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return -1;
+	char *line = fgets(buf, len, f);
+	fclose(f);
+
+	return line ? 0 : -1;
+}
+
+/* Fill in node_of[cpu] for every CPU from sysfs, or 0 where it is unknown.
+ */
+static void read_nodes(int *node_of)
+{
+	int cpus[AFFINITY_MAX_CPUS];
+	char path[64], line[4096];
+
+	memset(node_of, 0, AFFINITY_MAX_CPUS * sizeof(*node_of));
+	for (int node = 0; node < MAX_NODES; ++node) {  // node numbers may have gaps
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		if (read_line(path, line, sizeof(line)) != 0)
+			continue;
+		int n = parse_list(line, cpus, 0);
+		for (int i = 0; i < n; ++i)
+			node_of[cpus[i]] = node;
+	}
+}
+
+/* Return the NUMA node of the block device that holds the file open at fd,
+ * or -1 if it is not a file on a block device or sysfs does not tell.
+ */
+static int device_node(int fd)
+{
+	struct stat st;
+	char path[96], line[32];
+
+	if (fstat(fd, &st) != 0 || !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode)))
+		return -1;
+	dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+
+	// a partition has no device of its own, but its disk one level up does
+	static const char *const paths[] = { "/sys/dev/block/%u:%u/device/numa_node"
+	                                   , "/sys/dev/block/%u:%u/../device/numa_node" };
+	for (size_t i = 0; i < sizeof(paths) / sizeof(*paths); ++i) {
+		snprintf(path, sizeof(path), paths[i], major(dev), minor(dev));
+		if (read_line(path, line, sizeof(line)) == 0)
+			return atoi(line) < MAX_NODES ? atoi(line) : -1;  // -1 if the device has no node
+	}
+
+	return -1;
+}
+
+int affinity_init(struct Affinity *aff, const char *cpulist, int numa, int fd)
+{
+	cpu_set_t set;
+
+	if (sched_getaffinity(0, sizeof(set), &set) != 0)
+		return -1;
+	memset(aff->allowed, 0, sizeof(aff->allowed));
+	for (int cpu = 0; cpu < AFFINITY_MAX_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+		if (CPU_ISSET(cpu, &set))
+			aff->allowed[cpu / 8] |= 1 << cpu % 8;
+	}
+
+	aff->ncpus = 0;
+	if (cpulist) {
+		aff->ncpus = parse_list(cpulist, aff->cpus, 0);
+		for (int i = 0; i < aff->ncpus; ++i) {
+			if (!(aff->allowed[aff->cpus[i] / 8] & 1 << aff->cpus[i] % 8))
+				aff->ncpus = -1;
+		}
+	}
+	else {
+		for (int cpu = 0; cpu < AFFINITY_MAX_CPUS; ++cpu) {
+			if (aff->allowed[cpu / 8] & 1 << cpu % 8)
+				aff->cpus[aff->ncpus++] = cpu;
+		}
+	}
+	if (aff->ncpus <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(aff->nodes, 0, sizeof(aff->nodes));
+	aff->writer = -1;
+	aff->numa = numa;
+	if (!numa)
+		return 0;
+
+	// the CPUs node by node, from the node of the output device on
+	int node_of[AFFINITY_MAX_CPUS];
+	int cpus[AFFINITY_MAX_CPUS];
+	int n = 0;
+	read_nodes(node_of);
+	int start = device_node(fd);
+	if (start < 0)
+		start = node_of[aff->cpus[0]];
+	for (int k = 0; k < MAX_NODES; ++k) {
+		int node = (start + k) % MAX_NODES;
+		for (int i = 0; i < aff->ncpus; ++i) {
+			if (node_of[aff->cpus[i]] == node) {
+				aff->nodes[n] = node;
+				cpus[n++] = aff->cpus[i];
+			}
+		}
+	}
+	memcpy(aff->cpus, cpus, n * sizeof(*cpus));
+	for (int i = 0; i < n && aff->nodes[i] == aff->nodes[0]; ++i)
+		aff->writer = aff->cpus[i];
+	debug_print("%d CPUs from node %d on (the output device is on node %d), writer on CPU %d"
+	           , n, aff->nodes[0], device_node(fd), aff->writer);
+
+	return 0;
+}
+
+int affinity_pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+void affinity_unpin(const struct Affinity *aff)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	for (int cpu = 0; cpu < AFFINITY_MAX_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+		if (aff->allowed[cpu / 8] & 1 << cpu % 8)
+			CPU_SET(cpu, &set);
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
@@ -0,0 +1,95 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE  // explicit_bzero
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "debug.h"
+#include "stats.h"
+
+union Header { // in front of the memory of every buffer
+	struct {
+		union Header *next;  // next free buffer in the pool
+		size_t size;         // bytes after the header
+	} b;
+	long double align;       // keeps the memory aligned like that of malloc
+};
+
+struct BufferPool { // the free buffers of a thread
+	union Header *free;
+	unsigned count;
+};
+
+static __thread struct BufferPool pool;
+
+void *buffer_get(size_t size)
+{
+	union Header **best = NULL;
+
+	// the smallest free buffer that is large enough
+	for (union Header **p = &pool.free; *p; p = &(*p)->b.next) {
+		if ((*p)->b.size >= size && (!best || (*p)->b.size < (*best)->b.size))
+			best = p;
+	}
+	if (best) {
+		union Header *h = *best;
+		*best = h->b.next;
+		pool.count--;
+		stats_add(stat_buffer_reuses, 1);
+		return h + 1;
+	}
+
+	if (size > SIZE_MAX - sizeof(union Header))
+		return NULL;
+	union Header *h = calloc(1, sizeof(*h) + size);
+	if (!h)
+		return NULL;
+	h->b.size = size;
+	stats_add(stat_buffer_allocs, 1);
+	debug_print("allocated a buffer of %zu bytes", size);
+
+	return h + 1;
+}
+
+void buffer_put(void *buf)
+{
+	if (!buf)
+		return;
+
+	union Header *h = (union Header *)buf - 1;
+	buffer_wipe(buf, h->b.size);
+	if (pool.count == BUFFER_POOL_KEEP) {
+		free(h);
+		return;
+	}
+	h->b.next = pool.free;
+	pool.free = h;
+	pool.count++;
+}
+
+void buffer_release(void)
+{
+	while (pool.free) {
+		union Header *h = pool.free;
+		pool.free = h->b.next;
+		buffer_wipe(h + 1, h->b.size);
+		free(h);
+	}
+	pool.count = 0;
+}
+
+void buffer_wipe(void *p, size_t len)
+{
+	explicit_bzero(p, len);
+}
@@ -0,0 +1,341 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "device.h"
+
+#if OPENCL
+
+#include <dlfcn.h>
+#include <pthread.h>
+
+/* The few OpenCL types and constants used here, from the Khronos headers,
+ * so that building needs no OpenCL SDK.
+ */
+typedef int32_t cl_int;
+typedef uint32_t cl_uint;
+typedef uint64_t cl_ulong;
+typedef uint64_t cl_bitfield;
+typedef struct _cl_platform_id *cl_platform_id;
+typedef struct _cl_device_id *cl_device_id;
+typedef struct _cl_context *cl_context;
+typedef struct _cl_command_queue *cl_command_queue;
+typedef struct _cl_program *cl_program;
+typedef struct _cl_kernel *cl_kernel;
+typedef struct _cl_mem *cl_mem;
+typedef struct _cl_event *cl_event;
+
+#define CL_SUCCESS 0
+#define CL_TRUE 1
+#define CL_DEVICE_TYPE_GPU (1 << 2)
+#define CL_DEVICE_TYPE_ACCELERATOR (1 << 3)
+#define CL_MEM_WRITE_ONLY (1 << 1)
+#define CL_MEM_READ_ONLY (1 << 2)
+#define CL_MEM_ALLOC_HOST_PTR (1 << 4)
+#define CL_MEM_COPY_HOST_PTR (1 << 5)
+#define CL_MAP_READ (1 << 0)
+
+#define OPENCL_FUNCTIONS(X) \
+	X(cl_int, clGetPlatformIDs, (cl_uint, cl_platform_id *, cl_uint *)) \
+	X(cl_int, clGetDeviceIDs, (cl_platform_id, cl_bitfield, cl_uint, cl_device_id *, cl_uint *)) \
+	X(cl_context, clCreateContext, (const intptr_t *, cl_uint, const cl_device_id *, \
+	  void (*)(const char *, const void *, size_t, void *), void *, cl_int *)) \
+	X(cl_command_queue, clCreateCommandQueue, (cl_context, cl_device_id, cl_bitfield, cl_int *)) \
+	X(cl_program, clCreateProgramWithSource, (cl_context, cl_uint, const char **, const size_t *, cl_int *)) \
+	X(cl_int, clBuildProgram, (cl_program, cl_uint, const cl_device_id *, const char *, \
+	  void (*)(cl_program, void *), void *)) \
+	X(cl_kernel, clCreateKernel, (cl_program, const char *, cl_int *)) \
+	X(cl_mem, clCreateBuffer, (cl_context, cl_bitfield, size_t, void *, cl_int *)) \
+	X(cl_int, clSetKernelArg, (cl_kernel, cl_uint, size_t, const void *)) \
+	X(cl_int, clEnqueueNDRangeKernel, (cl_command_queue, cl_kernel, cl_uint, const size_t *, \
+	  const size_t *, const size_t *, cl_uint, const cl_event *, cl_event *)) \
+	X(cl_int, clEnqueueReadBuffer, (cl_command_queue, cl_mem, cl_uint, size_t, size_t, void *, \
+	  cl_uint, const cl_event *, cl_event *)) \
+	X(void *, clEnqueueMapBuffer, (cl_command_queue, cl_mem, cl_uint, cl_bitfield, size_t, size_t, \
+	  cl_uint, const cl_event *, cl_event *, cl_int *)) \
+	X(cl_int, clEnqueueUnmapMemObject, (cl_command_queue, cl_mem, void *, cl_uint, \
+	  const cl_event *, cl_event *)) \
+	X(cl_int, clFinish, (cl_command_queue)) \
+	X(cl_int, clReleaseMemObject, (cl_mem)) \
+	X(cl_int, clReleaseKernel, (cl_kernel)) \
+	X(cl_int, clReleaseProgram, (cl_program)) \
+	X(cl_int, clReleaseCommandQueue, (cl_command_queue)) \
+	X(cl_int, clReleaseContext, (cl_context))
+
+#define DECLARE(type, name, args) type (*name) args;
+struct OpenCL { // entry points of the OpenCL library
+	OPENCL_FUNCTIONS(DECLARE)
+};
+
+struct Device {
+	pthread_mutex_t lock;      // one block on the device at a time
+	void *library;             // handle of the OpenCL library
+	struct OpenCL cl;
+	cl_context context;
+	cl_command_queue queue;
+	cl_program program;
+	cl_kernel kernel;
+	cl_mem out;                // the records, in device memory
+	cl_mem staging;            // pinned host memory the records are read into
+	cl_mem symbols;            // lookup table of the pool
+	cl_mem key;                // device key as 8 little-endian words
+	char *host;                // staging, mapped into our address space
+	size_t reclen;
+	size_t max_records;
+};
+
+/* Every work item draws one record: word after word of the ChaCha20 block
+ * function at counters 0, 1, 2, ..., with the number of the record as the
+ * nonce (the layout of the chacha20 backend in random.c).
+ */
+static const char *const kernel_source =
+	"#define QR(a, b, c, d) \\\n"
+	"	a += b; d = rotate(d ^ a, 16u); c += d; b = rotate(b ^ c, 12u); \\\n"
+	"	a += b; d = rotate(d ^ a, 8u);  c += d; b = rotate(b ^ c, 7u);\n"
+	"__kernel void generate(__global uchar *out, __global const uchar *symbols,\n"
+	"                       __constant uint *key, uint range, uint threshold, uint pwlen,\n"
+	"                       uint reclen, uint terminator, ulong first)\n"
+	"{\n"
+	"	size_t id = get_global_id(0);\n"
+	"	ulong record = first + id;\n"
+	"	uint in[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,\n"
+	"	                key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],\n"
+	"	                0, 0, (uint)record, (uint)(record >> 32) };\n"
+	"	uint x[16];\n"
+	"	__global uchar *p = out + id * reclen;\n"
+	"	uint pos = 16;\n"
+	"	for (uint i = 0; i < pwlen; ) {\n"
+	"		if (pos == 16) {\n"
+	"			for (int k = 0; k < 16; ++k)\n"
+	"				x[k] = in[k];\n"
+	"			for (int r = 0; r < 10; ++r) {\n"
+	"				QR(x[0], x[4], x[8], x[12]) QR(x[1], x[5], x[9], x[13])\n"
+	"				QR(x[2], x[6], x[10], x[14]) QR(x[3], x[7], x[11], x[15])\n"
+	"				QR(x[0], x[5], x[10], x[15]) QR(x[1], x[6], x[11], x[12])\n"
+	"				QR(x[2], x[7], x[8], x[13]) QR(x[3], x[4], x[9], x[14])\n"
+	"			}\n"
+	"			for (int k = 0; k < 16; ++k)\n"
+	"				x[k] += in[k];\n"
+	"			if (++in[12] == 0)\n"
+	"				++in[13];\n"
+	"			pos = 0;\n"
+	"		}\n"
+	"		ulong m = (ulong)x[pos++] * range;\n"
+	"		if ((uint)m >= threshold)\n"
+	"			p[i++] = symbols[m >> 32];\n"
+	"	}\n"
+	"	if (reclen > pwlen)\n"
+	"		p[pwlen] = (uchar)terminator;\n"
+	"}\n";
+
+/* Load the entry points of the OpenCL library into *cl. Return the library
+ * handle, or NULL if it or a function is missing.
+ */
+static void *load_library(struct OpenCL *cl)
+{
+	void *library = dlopen("libOpenCL.so.1", RTLD_NOW | RTLD_LOCAL);
+	if (!library)
+		library = dlopen("libOpenCL.so", RTLD_NOW | RTLD_LOCAL);
+	if (!library)
+		return NULL;
+
+#define LOAD(type, name, args) \
+	if (!(*(void **)&cl->name = dlsym(library, #name))) { \
+		dlclose(library); \
+		return NULL; \
+	}
+	OPENCL_FUNCTIONS(LOAD)
+#undef LOAD
+
+	return library;
+}
+
+/* Find the first GPU, or failing that the first other accelerator, of any
+ * platform. Return 0 on success, or -1 if there is none.
+ */
+static int find_device(const struct OpenCL *cl, cl_device_id *id)
+{
+	cl_platform_id platforms[16];
+	cl_uint n;
+
+	if (cl->clGetPlatformIDs(16, platforms, &n) != CL_SUCCESS)
+		return -1;
+	if (n > 16)
+		n = 16;
+	for (cl_bitfield type = CL_DEVICE_TYPE_GPU; type <= CL_DEVICE_TYPE_ACCELERATOR; type <<= 1) {
+		for (cl_uint i = 0; i < n; ++i) {
+			cl_uint found;
+			if (cl->clGetDeviceIDs(platforms[i], type, 1, id, &found) == CL_SUCCESS && found > 0)
+				return 0;
+		}
+	}
+
+	return -1;
+}
+
+struct Device *device_open(const unsigned char *key, const char *symbols, const struct Sampler *sampler,
+                           size_t pwlen, size_t reclen, char terminator, size_t max_records)
+{
+	if (sampler->alias || pwlen > UINT32_MAX || reclen > UINT32_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+	struct Device *dev = calloc(1, sizeof(*dev));
+	if (!dev)
+		return NULL;
+	pthread_mutex_init(&dev->lock, NULL);
+	dev->reclen = reclen;
+	dev->max_records = max_records;
+
+	cl_device_id id;
+	dev->library = load_library(&dev->cl);
+	if (!dev->library || find_device(&dev->cl, &id) != 0) {
+		device_close(dev);
+		errno = ENODEV;
+		return NULL;
+	}
+
+	const struct OpenCL *cl = &dev->cl;
+	unsigned char subkey[RNG_KEY_BYTES];
+	uint32_t words[RNG_KEY_BYTES / 4];
+	rng_derive(key, UINT64_MAX - 1, subkey);  // UINT64_MAX keys the --unique fingerprints
+	for (int i = 0; i < RNG_KEY_BYTES / 4; ++i)
+		words[i] = (uint32_t)subkey[4 * i] | (uint32_t)subkey[4 * i + 1] << 8
+		         | (uint32_t)subkey[4 * i + 2] << 16 | (uint32_t)subkey[4 * i + 3] << 24;
+	memset(subkey, 0, sizeof(subkey));
+
+	size_t size = max_records * reclen;
+	cl_uint range = sampler->range, threshold = sampler->threshold;
+	cl_uint len = pwlen, rlen = reclen, term = (unsigned char)terminator;
+	cl_int err = CL_SUCCESS;
+	dev->context = cl->clCreateContext(NULL, 1, &id, NULL, NULL, &err);
+	if (err == CL_SUCCESS)
+		dev->queue = cl->clCreateCommandQueue(dev->context, id, 0, &err);
+	if (err == CL_SUCCESS)
+		dev->program = cl->clCreateProgramWithSource(dev->context, 1, (const char **)&kernel_source, NULL, &err);
+	if (err == CL_SUCCESS)
+		err = cl->clBuildProgram(dev->program, 1, &id, "", NULL, NULL);
+	if (err == CL_SUCCESS)
+		dev->kernel = cl->clCreateKernel(dev->program, "generate", &err);
+	if (err == CL_SUCCESS)
+		dev->out = cl->clCreateBuffer(dev->context, CL_MEM_WRITE_ONLY, size, NULL, &err);
+	if (err == CL_SUCCESS)
+		dev->staging = cl->clCreateBuffer(dev->context, CL_MEM_ALLOC_HOST_PTR, size, NULL, &err);
+	if (err == CL_SUCCESS)
+		dev->symbols = cl->clCreateBuffer(dev->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		                                  sampler->range, (void *)symbols, &err);
+	if (err == CL_SUCCESS)
+		dev->key = cl->clCreateBuffer(dev->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		                              sizeof(words), words, &err);
+	memset(words, 0, sizeof(words));
+	if (err == CL_SUCCESS)
+		dev->host = cl->clEnqueueMapBuffer(dev->queue, dev->staging, CL_TRUE, CL_MAP_READ, 0, size,
+		                                   0, NULL, NULL, &err);
+	cl_uint arg = 0;
+	if (err == CL_SUCCESS) err = cl->clSetKernelArg(dev->kernel, arg++, sizeof(cl_mem), &dev->out);
+	if (err == CL_SUCCESS) err = cl->clSetKernelArg(dev->kernel, arg++, sizeof(cl_mem), &dev->symbols);
+	if (err == CL_SUCCESS) err = cl->clSetKernelArg(dev->kernel, arg++, sizeof(cl_mem), &dev->key);
+	if (err == CL_SUCCESS) err = cl->clSetKernelArg(dev->kernel, arg++, sizeof(range), &range);
+	if (err == CL_SUCCESS) err = cl->clSetKernelArg(dev->kernel, arg++, sizeof(threshold), &threshold);
+	if (err == CL_SUCCESS) err = cl->clSetKernelArg(dev->kernel, arg++, sizeof(len), &len);
+	if (err == CL_SUCCESS) err = cl->clSetKernelArg(dev->kernel, arg++, sizeof(rlen), &rlen);
+	if (err == CL_SUCCESS) err = cl->clSetKernelArg(dev->kernel, arg++, sizeof(term), &term);
+	if (err != CL_SUCCESS) {
+		debug_print("OpenCL setup failed with error %d", (int)err);
+		device_close(dev);
+		errno = EIO;
+		return NULL;
+	}
+
+	return dev;
+}
+
+int device_fill(struct Device *dev, char *buf, uint64_t index, size_t count)
+{
+	const struct OpenCL *cl = &dev->cl;
+	cl_ulong first = index;
+	size_t len = count * dev->reclen;
+
+	if (count == 0)
+		return 0;
+	pthread_mutex_lock(&dev->lock);
+	cl_int err = cl->clSetKernelArg(dev->kernel, 8, sizeof(first), &first);
+	if (err == CL_SUCCESS)
+		err = cl->clEnqueueNDRangeKernel(dev->queue, dev->kernel, 1, NULL, &count, NULL, 0, NULL, NULL);
+	if (err == CL_SUCCESS)  // a DMA transfer into the pinned staging buffer
+		err = cl->clEnqueueReadBuffer(dev->queue, dev->out, CL_TRUE, 0, len, dev->host, 0, NULL, NULL);
+	if (err == CL_SUCCESS)
+		memcpy(buf, dev->host, len);
+	pthread_mutex_unlock(&dev->lock);
+
+	if (err != CL_SUCCESS) {
+		debug_print("OpenCL generation failed with error %d", (int)err);
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+void device_close(struct Device *dev)
+{
+	if (!dev)
+		return;
+
+	const struct OpenCL *cl = &dev->cl;
+	if (dev->host)
+		cl->clEnqueueUnmapMemObject(dev->queue, dev->staging, dev->host, 0, NULL, NULL);
+	if (dev->queue)
+		cl->clFinish(dev->queue);
+	cl_mem mems[] = { dev->out, dev->staging, dev->symbols, dev->key };
+	for (size_t i = 0; i < sizeof(mems) / sizeof(*mems); ++i) {
+		if (mems[i])
+			cl->clReleaseMemObject(mems[i]);
+	}
+	if (dev->kernel)
+		cl->clReleaseKernel(dev->kernel);
+	if (dev->program)
+		cl->clReleaseProgram(dev->program);
+	if (dev->queue)
+		cl->clReleaseCommandQueue(dev->queue);
+	if (dev->context)
+		cl->clReleaseContext(dev->context);
+	if (dev->library)
+		dlclose(dev->library);
+	pthread_mutex_destroy(&dev->lock);
+	free(dev);
+}
+
+#else
+
+struct Device *device_open(const unsigned char *key, const char *symbols, const struct Sampler *sampler,
+                           size_t pwlen, size_t reclen, char terminator, size_t max_records)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+int device_fill(struct Device *device, char *buf, uint64_t index, size_t count)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+void device_close(struct Device *device)
+{
+}
+
+#endif
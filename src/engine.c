@@ -0,0 +1,640 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "affinity.h"
+#include "buffer.h"
+#include "debug.h"
+#include "engine.h"
+#include "format.h"
+#include "output.h"
+#include "random.h"
+#include "stats.h"
+
+/* The threaded engine passes blocks of passwords from the generator threads
+ * to a dedicated writer thread through a lock-free ring of RING_DEPTH slots
+ * per generator. Block i always goes through slot i % nslots; since nslots
+ * is a multiple of nthreads, every slot has a single producer (the thread
+ * generating its blocks) and a single consumer (the writer), and the slots
+ * hand over through their sequence numbers alone:
+ *
+ *   seq == i        the slot is free for block i
+ *   seq == i + 1    block i is filled and waits for the writer
+ *
+ * and the writer frees the slot for block i + nslots once it has written
+ * block i. A full ring is the high-water mark: a generator that gets
+ * nslots blocks ahead of the writer waits for its slot to be freed, which
+ * bounds the memory in flight however slow the reader of the output is.
+ */
+#define RING_DEPTH 4      // slots of the ring per generator thread
+#define SPIN_LIMIT 128    // busy polls of a slot before yielding the processor
+#define YIELD_LIMIT 1024  // yields before sleeping between polls
+#define POLL_SLEEP_NS (50 * 1000)
+
+struct Slot { // buffer for one block of passwords on its way to the writer
+	char *buf;              // records of the block
+	size_t len;             // number of bytes in buf
+	uint64_t seq;           // handover state of the slot (see above), accessed atomically
+};
+
+struct Group { // generator threads that take the blocks of their members in turns
+	uint64_t claims;        // number of blocks taken so far, accessed atomically
+	int first;              // the members are shared->members[first] ...
+	int size;               // ... up to shared->members[first + size - 1]
+};
+
+struct Shared { // state shared by the writer and all generator threads
+	const struct Job *job;
+	size_t block_records;   // number of passwords in a full block
+	uint64_t nblocks;       // total number of blocks to generate (UINT64_MAX for no limit)
+	int nthreads;
+	int nslots;
+	struct Slot *slots;     // the ring; with numa, the buffers are allocated on first use
+	struct Group *groups;   // which threads take the blocks of which (see next_block)
+	int *members;           // ids of the threads, group by group, in increasing order
+	const struct Affinity *affinity;  // job->affinity, or NULL with a single thread
+	char *map;              // the whole output in memory, or NULL
+	struct Output *out;     // where the writer sends the blocks
+	int abort;              // set atomically when the pipeline has to stop early
+	int status;             // result of the writer
+	int error;              // errno of the writer, if it failed
+};
+
+struct Worker { // a generator thread
+	struct Shared *shared;
+	int id;                 // blocks id, id+nthreads, ... are this thread's, to be
+	struct Group *group;    // generated by it or by the others of its group
+	struct RandomState rng; // generator owned by this thread
+	int error;              // errno of a failed allocation, or 0
+	pthread_t thread;
+};
+
+#define PACK_CHUNK 4096  // symbol indices generated at a time for the packed format
+#define UNIQUE_BATCH 32  // records whose slots are prefetched at a time in the unique mode
+
+static size_t record_len(const struct Job *job)
+{
+	return format_record_len(job->format, job->pwlen, job->sampler.range);
+}
+
+struct BitWriter { // appends bit fields to a byte string, least significant bit first
+	unsigned char *p;  // next byte to write
+	uint32_t acc;      // bits not yet written
+	unsigned n;        // number of bits in acc
+};
+
+static void put_bits(struct BitWriter *bw, const char *idx, size_t count, unsigned bits)
+{
+	for (size_t i = 0; i < count; ++i) {
+		bw->acc |= (uint32_t)(unsigned char)idx[i] << bw->n;
+		for (bw->n += bits; bw->n >= 8; bw->n -= 8) {
+			*bw->p++ = (unsigned char)bw->acc;
+			bw->acc >>= 8;
+		}
+	}
+}
+
+static void end_bits(struct BitWriter *bw)
+{
+	if (bw->n > 0)
+		*bw->p++ = (unsigned char)bw->acc;
+	bw->acc = bw->n = 0;
+}
+
+/* Generate count packed records into buf. The symbol indices are drawn as
+ * the characters of an identity table, so every kernel can be used.
+ */
+static void pack_block(const struct Job *job, struct RandomState *rng, char *buf, size_t count)
+{
+	char identity[FORMAT_MAX_PACKED_RANGE];
+	char idx[PACK_CHUNK];
+	unsigned bits = format_packed_bits(job->sampler.range);
+	size_t per_chunk = PACK_CHUNK / job->pwlen;  // whole records per chunk, if any
+	struct BitWriter bw = { (unsigned char *)buf, 0, 0 };
+
+	assert(job->sampler.range <= FORMAT_MAX_PACKED_RANGE);
+	for (int i = 0; i < FORMAT_MAX_PACKED_RANGE; ++i)
+		identity[i] = (char)i;
+
+	for (size_t done = 0; done < count; ) {
+		if (per_chunk > 0) { // many short records from each chunk
+			size_t n = count - done < per_chunk ? count - done : per_chunk;
+			str_randomize(rng, idx, n * job->pwlen, identity, &job->sampler);
+			for (size_t r = 0; r < n; ++r) {
+				put_bits(&bw, idx + r * job->pwlen, job->pwlen, bits);
+				end_bits(&bw);
+			}
+			done += n;
+		}
+		else { // a long record out of many chunks
+			for (size_t left = job->pwlen; left > 0; ) {
+				size_t n = left < PACK_CHUNK ? left : PACK_CHUNK;
+				str_randomize(rng, idx, n, identity, &job->sampler);
+				put_bits(&bw, idx, n, bits);
+				left -= n;
+			}
+			end_bits(&bw);
+			++done;
+		}
+	}
+	assert((char *)bw.p == buf + count * record_len(job));
+}
+
+/* Generate count records of job->pattern into buf.
+ */
+static void fill_pattern(const struct Job *job, struct RandomState *rng, char *buf, size_t count)
+{
+	size_t reclen = record_len(job);
+	char terminator = job->format == format_text ? '\n' : '\0';  // unless format_raw
+
+	assert(job->format != format_packed);
+	for (size_t r = 0; r < count; ++r, buf += reclen) {
+		pattern_randomize(rng, buf, job->pattern);
+		if (reclen > job->pwlen)
+			buf[job->pwlen] = terminator;
+	}
+}
+
+/* Generate count consecutive passwords into buf, as records of job->format.
+ */
+static void fill_block(const struct Job *job, struct RandomState *rng, char *buf, size_t count)
+{
+	uint64_t start = stats_clock();
+
+	if (job->pattern) {
+		fill_pattern(job, rng, buf, count);
+		stats_add(stat_generate_ns, stats_clock() - start);
+		return;
+	}
+	switch (job->format) {
+		case format_text:
+			records_randomize(rng, buf, count, job->pwlen, '\n', job->symbols, &job->sampler);
+			break;
+		case format_nul:
+			records_randomize(rng, buf, count, job->pwlen, '\0', job->symbols, &job->sampler);
+			break;
+		case format_raw:
+			str_randomize(rng, buf, count * job->pwlen, job->symbols, &job->sampler);
+			break;
+		case format_packed:
+			pack_block(job, rng, buf, count);
+			break;
+	}
+	if (job->policy)
+		policy_apply(job->policy, rng, buf, count, record_len(job), job->pwlen);
+	stats_add(stat_generate_ns, stats_clock() - start);
+}
+
+/* Add the count (at most UNIQUE_BATCH) records at buf to job->unique,
+ * drawing the ones already there again. The slots of the whole batch are
+ * prefetched first, so that their cache misses overlap.
+ */
+static void make_unique(const struct Job *job, struct RandomState *rng, char *buf, size_t count)
+{
+	size_t reclen = record_len(job);
+	uint64_t h[UNIQUE_BATCH];
+
+	for (size_t r = 0; r < count; ++r) {
+		h[r] = unique_fingerprint(job->unique, buf + r * reclen, reclen);
+		unique_prefetch(job->unique, h[r]);
+	}
+	for (size_t r = 0; r < count; ++r) {
+		char *rec = buf + r * reclen;
+		if (unique_add(job->unique, h[r]))
+			continue;
+		do
+			fill_block(job, rng, rec, 1);
+		while (!unique_insert(job->unique, rec, reclen));
+	}
+}
+
+/* Generate count passwords into buf, starting from password number index of
+ * the job. Without job->indexed they just continue the sequence of rng;
+ * otherwise every password is drawn on its own from the stream of its group
+ * (see engine.h), skipping the passwords of the group before index.
+ */
+static void fill_records(const struct Job *job, struct RandomState *rng, char *buf, uint64_t index, size_t count)
+{
+	size_t reclen = record_len(job);
+
+	if (!job->indexed) {
+		uint64_t start = stats_clock();
+		if (job->device && device_fill(job->device, buf, index, count) == 0) {
+			if (job->policy)
+				policy_apply(job->policy, rng, buf, count, reclen, job->pwlen);
+			stats_add(stat_generate_ns, stats_clock() - start);
+		}
+		else
+			fill_block(job, rng, buf, count);
+		for (size_t r = 0; job->unique && r < count; r += UNIQUE_BATCH)
+			make_unique(job, rng, buf + r * reclen, count - r < UNIQUE_BATCH ? count - r : UNIQUE_BATCH);
+		return;
+	}
+
+	uint64_t i = job->first + index;
+	if (count > 0 && i % ENGINE_GROUP_RECORDS != 0) {
+		rng_init(rng, job->rng, job->key, i / ENGINE_GROUP_RECORDS);
+		for (uint64_t k = 0; k < i % ENGINE_GROUP_RECORDS; ++k)
+			fill_block(job, rng, buf, 1);  // overwritten below
+	}
+	for (size_t r = 0; r < count; ++r, ++i) {
+		if (i % ENGINE_GROUP_RECORDS == 0)
+			rng_init(rng, job->rng, job->key, i / ENGINE_GROUP_RECORDS);
+		fill_block(job, rng, buf + r * reclen, 1);
+	}
+}
+
+static size_t block_count(const struct Shared *sh, uint64_t block)
+{
+	if (sh->job->pwcount == 0)
+		return sh->block_records;
+
+	uint64_t left = sh->job->pwcount - block * sh->block_records;
+	return left < sh->block_records ? (size_t)left : sh->block_records;
+}
+
+/* Return the number of blocks of block_records passwords in *job.
+ */
+static uint64_t block_total(const struct Job *job, size_t block_records)
+{
+	if (job->pwcount == 0)
+		return UINT64_MAX;
+	return job->pwcount / block_records + (job->pwcount % block_records != 0);
+}
+
+/* Wait until the sequence number of slot becomes seq, polling with a
+ * backoff from spinning to yielding to short sleeps, so that a waiting
+ * thread leaves the processor to the others when the wait gets long.
+ * Return 0 once it does, or -1 if the pipeline is aborted meanwhile.
+ */
+static int slot_wait(struct Shared *sh, struct Slot *slot, uint64_t seq)
+{
+	unsigned polls = 0;
+
+	while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq) {
+		if (__atomic_load_n(&sh->abort, __ATOMIC_RELAXED))
+			return -1;
+		if (polls < YIELD_LIMIT)
+			++polls;
+		if (polls > SPIN_LIMIT && polls < YIELD_LIMIT)
+			sched_yield();
+		else if (polls == YIELD_LIMIT) {
+			struct timespec ts = { 0, POLL_SLEEP_NS };
+			nanosleep(&ts, NULL);
+		}
+	}
+
+	return 0;
+}
+
+/* Put the generator threads of sh into groups: each thread into one of its
+ * own, unless sh->affinity is set, and then all threads into one, or with
+ * numa the threads of every node into one. Return 0 on success, or -1 if
+ * the allocation failed.
+ */
+static int make_groups(struct Shared *sh, struct Worker *workers)
+{
+	const struct Affinity *aff = sh->affinity;
+	int ngroups = 0;
+
+	sh->groups = buffer_get(sh->nthreads * sizeof(*(sh->groups)));
+	sh->members = buffer_get(sh->nthreads * sizeof(*(sh->members)));
+	if (!sh->groups || !sh->members)
+		return -1;
+
+	int *key = sh->members;  // the node of every group, until the members go in
+	for (int id = 0; id < sh->nthreads; ++id) {
+		int node = !aff ? id : aff->numa ? aff->nodes[id % aff->ncpus] : 0;
+		int g = 0;
+		while (g < ngroups && key[g] != node)
+			++g;
+		if (g == ngroups)
+			key[ngroups++] = node;
+		workers[id].group = &sh->groups[g];
+		sh->groups[g].size++;
+	}
+	for (int g = 1; g < ngroups; ++g)
+		sh->groups[g].first = sh->groups[g - 1].first + sh->groups[g - 1].size;
+	for (int g = 0; g < ngroups; ++g)
+		sh->groups[g].size = 0;
+	for (int id = 0; id < sh->nthreads; ++id) {
+		struct Group *g = workers[id].group;
+		sh->members[g->first + g->size++] = id;
+	}
+	debug_print("%d threads in %d groups", sh->nthreads, ngroups);
+
+	return 0;
+}
+
+/* Take the next block for w, or return sh->nblocks if there are none left.
+ * The threads of a group take the blocks of all the members in turns (one
+ * of every member, in the order of their ids, then the next ones), so that
+ * a thread that falls behind leaves its blocks to the others of its group;
+ * a thread of its own group just gets its own blocks in order.
+ */
+static uint64_t next_block(struct Worker *w)
+{
+	struct Shared *sh = w->shared;
+	struct Group *g = w->group;
+
+	uint64_t claim = __atomic_fetch_add(&g->claims, 1, __ATOMIC_RELAXED);
+	uint64_t i = claim / g->size * sh->nthreads + sh->members[g->first + claim % g->size];
+	return i < sh->nblocks ? i : sh->nblocks;
+}
+
+/* Ready the generator of w for block i. On pinned threads, which thread
+ * gets a block depends on timing, so then every block is drawn from a
+ * stream of its own instead of that of the thread.
+ */
+static void start_block(struct Worker *w, uint64_t i)
+{
+	const struct Job *job = w->shared->job;
+
+	if (w->shared->affinity)
+		rng_init(&w->rng, job->rng, job->key, i);
+}
+
+/* Pin the generator thread w to its CPU of sh->affinity, if any.
+ */
+static void pin_worker(struct Worker *w)
+{
+	const struct Affinity *aff = w->shared->affinity;
+
+	if (aff && affinity_pin(aff->cpus[w->id % aff->ncpus]) != 0)
+		debug_print("could not pin thread %d: %s", w->id, strerror(errno));
+}
+
+static void *worker_main(void *arg)
+{
+	struct Worker *w = arg;
+	struct Shared *sh = w->shared;
+	size_t reclen = record_len(sh->job);
+
+	pin_worker(w);
+	for (uint64_t i = next_block(w); i < sh->nblocks; i = next_block(w)) {
+		struct Slot *slot = &sh->slots[i % sh->nslots];
+		if (slot_wait(sh, slot, i) != 0)
+			break;
+
+		// with numa, the first thread to use a slot is on the node of its
+		// group, and the pages of its buffer go where they are first touched
+		if (!slot->buf && !(slot->buf = buffer_get(sh->block_records * reclen))) {
+			w->error = errno;
+			__atomic_store_n(&sh->abort, 1, __ATOMIC_RELAXED);
+			break;
+		}
+		size_t count = block_count(sh, i);
+		start_block(w, i);
+		fill_records(sh->job, &w->rng, slot->buf, i * sh->block_records, count);
+		slot->len = count * reclen;
+		__atomic_store_n(&slot->seq, i + 1, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+/* Generate the blocks of this thread directly at their place in sh->map.
+ * The blocks are disjoint, so no locking is needed.
+ */
+static void *mapped_main(void *arg)
+{
+	struct Worker *w = arg;
+	struct Shared *sh = w->shared;
+	size_t block_len = sh->block_records * record_len(sh->job);
+
+	pin_worker(w);
+	for (uint64_t i = next_block(w); i < sh->nblocks; i = next_block(w)) {
+		start_block(w, i);
+		fill_records(sh->job, &w->rng, sh->map + i * block_len, i * sh->block_records, block_count(sh, i));
+	}
+
+	return NULL;
+}
+
+/* Pass the blocks from the slots to sh->out in order, until all blocks
+ * have been written, writing fails or the pipeline is aborted.
+ */
+static void *writer_main(void *arg)
+{
+	struct Shared *sh = arg;
+	const struct Affinity *aff = sh->affinity;
+
+	if (aff && aff->writer >= 0 && affinity_pin(aff->writer) != 0)
+		debug_print("could not pin the writer: %s", strerror(errno));
+
+	for (uint64_t i = 0; i < sh->nblocks; ++i) {
+		struct Slot *slot = &sh->slots[i % sh->nslots];
+		if (slot_wait(sh, slot, i + 1) != 0)
+			break;
+
+		if (output_write(sh->out, slot->buf, slot->len) != 0) {
+			sh->status = -1;
+			sh->error = errno;
+			__atomic_store_n(&sh->abort, 1, __ATOMIC_RELAXED);
+			break;
+		}
+		__atomic_store_n(&slot->seq, i + sh->nslots, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+static int run_single(const struct Job *job, struct Output *out, struct RandomState *rng)
+{
+	size_t reclen = record_len(job);
+	size_t block_records = out->size / reclen;
+	uint64_t left = job->pwcount;
+	uint64_t done = 0;
+
+	while (job->pwcount == 0 || left > 0) {
+		size_t count = job->pwcount == 0 || left > block_records ? block_records : (size_t)left;
+		if (job->pwcount)
+			left -= count;
+		char *block = output_reserve(out, count * reclen);
+		if (!block)
+			return -1;
+		fill_records(job, rng, block, done, count);
+		done += count;
+	}
+
+	return 0;
+}
+
+static int run_threaded(const struct Job *job, struct Output *out, int nthreads)
+{
+	size_t reclen = record_len(job);
+	struct Shared sh = { 0 };
+
+	sh.job = job;
+	sh.block_records = out->size / reclen ? out->size / reclen : 1;
+	sh.nblocks = block_total(job, sh.block_records);
+	sh.nthreads = nthreads;
+	sh.nslots = RING_DEPTH * nthreads;
+	sh.out = out;
+	sh.affinity = job->affinity;
+
+	int status = 0;
+	int started = 0;  // number of generator threads running, besides the calling thread
+	pthread_t writer;
+	// from the pool of this thread, so that a run after the first allocates
+	// nothing; the buffers and the generator states are wiped when given back
+	struct Worker *workers = buffer_get(nthreads * sizeof(*workers));
+	sh.slots = buffer_get(sh.nslots * sizeof(*(sh.slots)));
+	int numa = sh.affinity && sh.affinity->numa;
+	for (int i = 0; sh.slots && i < sh.nslots; ++i) {
+		sh.slots[i].buf = numa ? NULL : buffer_get(sh.block_records * reclen);
+		sh.slots[i].seq = i;
+		if (!sh.slots[i].buf && !numa)
+			status = -1;
+	}
+	if (!workers || !sh.slots || make_groups(&sh, workers) != 0)
+		status = -1;
+
+	for (int i = 0; status == 0 && i < nthreads; ++i) {
+		struct Worker *w = &workers[i];
+		w->shared = &sh;
+		w->id = i;
+		rng_init(&w->rng, job->rng, job->key, i);
+	}
+	int writing = 0;  // whether the writer thread is running
+	if (status == 0) {
+		int err = pthread_create(&writer, NULL, writer_main, &sh);
+		if (err) {
+			errno = err;
+			status = -1;
+		}
+		else
+			writing = 1;
+	}
+	// the calling thread generates the blocks of worker 0
+	for (; status == 0 && started + 1 < nthreads; ++started) {
+		struct Worker *w = &workers[started + 1];
+		int err = pthread_create(&w->thread, NULL, worker_main, w);
+		if (err) {
+			errno = err;
+			status = -1;
+			__atomic_store_n(&sh.abort, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	debug_print("started %d threads and a writer for %llu blocks of %zu records", started + 1
+	           , (unsigned long long)sh.nblocks, sh.block_records);
+	if (status == 0)
+		worker_main(&workers[0]);
+
+	int saved_errno = errno;
+	for (int i = 1; i <= started; ++i)
+		pthread_join(workers[i].thread, NULL);
+	if (writing)
+		pthread_join(writer, NULL);
+	if (status == 0 && sh.status != 0) {
+		status = sh.status;
+		saved_errno = sh.error;
+	}
+	for (int i = 0; status == 0 && i < nthreads; ++i) {
+		if (workers[i].error) {
+			status = -1;
+			saved_errno = workers[i].error;
+		}
+	}
+	if (sh.affinity)  // the calling thread was worker 0
+		affinity_unpin(sh.affinity);
+
+	for (int i = 0; sh.slots && i < sh.nslots; ++i)
+		buffer_put(sh.slots[i].buf);
+	buffer_put(sh.slots);
+	buffer_put(sh.groups);
+	buffer_put(sh.members);
+	buffer_put(workers);
+	errno = saved_errno;
+
+	return status;
+}
+
+int engine_run_mapped(const struct Job *job, char *map, size_t block_records, int nthreads)
+{
+	struct Shared sh = { 0 };
+
+	assert(0 < nthreads && 0 < block_records && 0 < job->pwcount);
+	if (record_len(job) == 0)
+		return 0;  // nothing to generate
+	sh.job = job;
+	sh.block_records = block_records;
+	sh.nblocks = block_total(job, block_records);
+	sh.nthreads = nthreads;
+	sh.map = map;
+	sh.affinity = nthreads > 1 ? job->affinity : NULL;
+
+	struct Worker *workers = buffer_get(nthreads * sizeof(*workers));
+	if (!workers || make_groups(&sh, workers) != 0) {
+		buffer_put(sh.groups);
+		buffer_put(sh.members);
+		buffer_put(workers);
+		return -1;
+	}
+
+	int status = 0;
+	int started = 0;
+	for (; started < nthreads; ++started) {
+		struct Worker *w = &workers[started];
+		w->shared = &sh;
+		w->id = started;
+		rng_init(&w->rng, job->rng, job->key, started);
+		if (nthreads == 1) { // all work is done in the calling thread
+			mapped_main(w);
+			break;
+		}
+
+		int err = pthread_create(&w->thread, NULL, mapped_main, w);
+		if (err) {
+			errno = err;
+			status = -1;
+			break;
+		}
+	}
+	if (nthreads > 1) {
+		for (int i = 0; i < started; ++i)
+			pthread_join(workers[i].thread, NULL);
+	}
+	buffer_put(sh.groups);
+	buffer_put(sh.members);
+	buffer_put(workers);
+
+	return status;
+}
+
+int engine_run(const struct Job *job, struct Output *out, int nthreads)
+{
+	assert(0 < nthreads);
+	assert(0 < job->sampler.range);
+	if (record_len(job) == 0)
+		return 0;  // nothing to generate
+
+	if (nthreads == 1) {
+		struct RandomState rng;
+		rng_init(&rng, job->rng, job->key, 0);
+		int status = run_single(job, out, &rng);
+		rng_wipe(&rng);
+		return status;
+	}
+	else
+		return run_threaded(job, out, nthreads);
+}
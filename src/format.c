@@ -0,0 +1,90 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <string.h>
+
+#include "format.h"
+
+#define PACKED_MAGIC "PWGPACK1"
+#define PACKED_HEADER_LEN 28  // bytes before the pool in the packed header
+
+static const char *const format_names[] = { "text", "nul", "raw", "packed" };
+
+int format_find(const char *name, enum record_format *format)
+{
+	for (size_t i = 0; i < sizeof(format_names) / sizeof(*format_names); ++i) {
+		if (strcmp(format_names[i], name) == 0) {
+			*format = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char *format_name(enum record_format format)
+{
+	return format_names[format];
+}
+
+unsigned format_packed_bits(uint32_t range)
+{
+	unsigned bits = 1;
+
+	while (bits < 32 && (UINT32_C(1) << bits) < range)
+		++bits;
+	return bits;
+}
+
+size_t format_record_len(enum record_format format, size_t pwlen, uint32_t range)
+{
+	switch (format) {
+		case format_text:
+		case format_nul:
+			return pwlen + 1;
+		case format_raw:
+			return pwlen;
+		case format_packed:
+			return (pwlen * format_packed_bits(range) + 7) / 8;
+	}
+	assert(0);
+	return 0;
+}
+
+size_t format_header_len(enum record_format format, uint32_t range)
+{
+	return format == format_packed ? PACKED_HEADER_LEN + range : 0;
+}
+
+/* Store the n lowest bytes of x into p in little-endian order.
+ */
+static char *store_le(char *p, uint64_t x, int n)
+{
+	for (int i = 0; i < n; ++i, x >>= 8)
+		*p++ = (char)(x & 0xff);
+	return p;
+}
+
+void format_header(enum record_format format, char *buf, size_t pwlen, uint64_t count,
+                   const char *symbols, uint32_t range)
+{
+	if (format != format_packed)
+		return;
+
+	memcpy(buf, PACKED_MAGIC, 8);
+	char *p = store_le(buf + 8, pwlen, 4);
+	p = store_le(p, range, 4);
+	p = store_le(p, count, 8);
+	p = store_le(p, format_packed_bits(range), 4);
+	assert(p == buf + PACKED_HEADER_LEN);
+	assert(PACKED_HEADER_LEN + range <= FORMAT_MAX_HEADER_LEN);
+	memcpy(p, symbols, range);
+}
@@ -0,0 +1,283 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE  // MAP_ANONYMOUS, MADV_WIPEONFORK
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "gensyms.h"
+#include "pool.h"
+#include "pwgen.h"
+#include "random.h"
+#include "seed.h"
+
+#define DEFAULT_symbols "asciipns"
+#define BLOCK_SIZE 4096  // bytes of passwords generated at a time for pwgen_next
+
+struct Block { // passwords generated ahead for pwgen_next and pwgen_foreach
+	size_t left;               // number of passwords not yet handed out
+	size_t len;                // their length
+	size_t next;               // offset of the next one in records
+	char records[];            // the passwords, each followed by a '\0'
+};
+
+struct pwgen_ctx {
+	Pool pool;                 // symbols added by the caller
+	const RandomBackend *backend;
+	unsigned char key[RNG_KEY_BYTES];
+	RandomState rng;
+	uint64_t stream;           // stream of key that rng is on (see pwgen_set_rng)
+	Sampler sampler;           // sampler for the pool in use
+	AliasTable alias;          // weights of a heavily weighted pool (see pool_prepare)
+	const char *symbols;       // the pool in use: pool.symbols, or the default set
+	int stale;                 // pool has changed since sampler was set up
+	pid_t pid;                 // process that seeded key from the system, or 0
+	struct Block *block;       // mapped memory of block_size bytes, or NULL
+	size_t block_size;
+	int wiped_on_fork;         // the kernel zeroes the block in a child process
+};
+
+/* Overwrite n bytes at p with zeros, in a way the compiler may not omit
+ * even though the memory is about to be freed.
+ */
+static void wipe(void *p, size_t n)
+{
+	volatile unsigned char *q = p;
+
+	while (n--)
+		*q++ = 0;
+}
+
+/* Throw away the passwords left in the block of ctx.
+ */
+static void drop_block(pwgen_ctx *ctx)
+{
+	if (ctx->block)
+		wipe(ctx->block, ctx->block_size);
+}
+
+/* Have the block of ctx zeroed in a child process after fork(2), and so be
+ * refilled there by pwgen_fill, which reseeds, if ctx was seeded by the
+ * system; a context seeded by the caller keeps the block, as the child has
+ * to go on with the same passwords. Without kernel support for this, the
+ * process is checked on every call instead.
+ */
+static void advise_block(pwgen_ctx *ctx)
+{
+	ctx->wiped_on_fork = 0;
+#if defined(MADV_WIPEONFORK) && defined(MADV_KEEPONFORK)
+	int advice = ctx->pid ? MADV_WIPEONFORK : MADV_KEEPONFORK;
+	ctx->wiped_on_fork = madvise(ctx->block, ctx->block_size, advice) == 0 && ctx->pid;
+#endif
+}
+
+/* Return the next password of len characters from the block of ctx, first
+ * refilling it if it has none of that length left. Return NULL on failure
+ * (errno is set).
+ */
+static const char *block_take(pwgen_ctx *ctx, size_t len)
+{
+	struct Block *b = ctx->block;
+
+	if (b && ctx->pid && !ctx->wiped_on_fork && ctx->pid != getpid())
+		b->left = 0;  // the parent may still hand out the same passwords
+	if (!b || b->left == 0 || b->len != len) {
+		if (len >= SIZE_MAX - offsetof(struct Block, records) - BLOCK_SIZE) {
+			errno = EINVAL;
+			return NULL;
+		}
+		size_t need = offsetof(struct Block, records) + len + 1;
+		if (!b || ctx->block_size < need) { // a longer password than ever before
+			size_t size = need > BLOCK_SIZE ? (need + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE : BLOCK_SIZE;
+			void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (map == MAP_FAILED)
+				return NULL;
+			if (b) {
+				drop_block(ctx);
+				munmap(b, ctx->block_size);
+			}
+			b = ctx->block = map;
+			ctx->block_size = size;
+			advise_block(ctx);
+		}
+		size_t count = (ctx->block_size - offsetof(struct Block, records)) / (len + 1);
+		if (pwgen_fill(ctx, b->records, count, len) != 0)
+			return NULL;
+		b->left = count;
+		b->len = len;
+		b->next = 0;
+	}
+
+	const char *password = b->records + b->next;
+	b->next += len + 1;
+	b->left--;
+	return password;
+}
+
+pwgen_ctx *pwgen_new(void)
+{
+	pwgen_ctx *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+
+	pool_init(&ctx->pool);
+	if (seed_random(ctx->key, sizeof(ctx->key)) != 0) {
+		int err = errno;
+		pwgen_free(ctx);
+		errno = err;
+		return NULL;
+	}
+	ctx->pid = getpid();
+	ctx->backend = &rng_chacha20;
+	rng_init(&ctx->rng, ctx->backend, ctx->key, 0);
+	ctx->stale = 1;
+
+	return ctx;
+}
+
+void pwgen_free(pwgen_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	pool_free(&ctx->pool);
+	if (ctx->block) {
+		drop_block(ctx);
+		munmap(ctx->block, ctx->block_size);
+	}
+	wipe(ctx, sizeof(*ctx));
+	free(ctx);
+}
+
+int pwgen_add_set(pwgen_ctx *ctx, const char *name)
+{
+	uint32_t weight;
+	const struct SymbolSet *p = symbol_set_parse(name, &weight);
+
+	if (!p || weight == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (pool_add(&ctx->pool, p->data, weight) != 0)
+		return -1;
+	ctx->stale = 1;
+	drop_block(ctx);
+
+	return 0;
+}
+
+int pwgen_add_symbols(pwgen_ctx *ctx, const char *symbols)
+{
+	if (pool_add(&ctx->pool, symbols, 1) != 0)
+		return -1;
+	ctx->stale = 1;
+	drop_block(ctx);
+
+	return 0;
+}
+
+int pwgen_set_rng(pwgen_ctx *ctx, const char *name)
+{
+	const struct RandomBackend *backend = rng_backend_find(name);
+
+	if (!backend) {
+		errno = EINVAL;
+		return -1;
+	}
+	ctx->backend = backend;
+	// a stream not used since seeding, as going back to the start of one
+	// would hand out the same passwords again
+	rng_init(&ctx->rng, ctx->backend, ctx->key, ++ctx->stream);
+	drop_block(ctx);
+
+	return 0;
+}
+
+int pwgen_seed(pwgen_ctx *ctx, const void *key, size_t len)
+{
+	memset(ctx->key, 0, sizeof(ctx->key));
+	memcpy(ctx->key, key, len < sizeof(ctx->key) ? len : sizeof(ctx->key));
+	ctx->stream = 0;
+	rng_init(&ctx->rng, ctx->backend, ctx->key, 0);
+	ctx->pid = 0;  // the caller asked for this sequence, even in a child process
+	drop_block(ctx);
+	if (ctx->block)
+		advise_block(ctx);
+
+	return 0;
+}
+
+int pwgen_fill(pwgen_ctx *ctx, char *buf, size_t count, size_t len)
+{
+	if (len == SIZE_MAX || (count > 0 && len + 1 > SIZE_MAX / count)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (ctx->pid && ctx->pid != getpid()) {
+		// forked since seeding: without a new seed, the child would repeat
+		// the passwords of the parent
+		if (seed_random(ctx->key, sizeof(ctx->key)) != 0)
+			return -1;
+		ctx->stream = 0;
+		rng_init(&ctx->rng, ctx->backend, ctx->key, 0);
+		ctx->pid = getpid();
+	}
+
+	if (ctx->stale) { // the pool has changed, so the sampler must be rebuilt
+		if (ctx->pool.total > 0) {
+			if (pool_prepare(&ctx->pool, &ctx->alias, &ctx->sampler, POOL_ALIAS_LEN) != 0)
+				return -1;
+			ctx->symbols = ctx->pool.symbols;
+		}
+		else {
+			const struct SymbolSet *p = symbol_set_find(DEFAULT_symbols);
+			ctx->symbols = p->data;
+			sampler_init(&ctx->sampler, p->size);
+		}
+		ctx->stale = 0;
+	}
+	records_randomize(&ctx->rng, buf, count, len, '\0', ctx->symbols, &ctx->sampler);
+
+	return 0;
+}
+
+int pwgen_next(pwgen_ctx *ctx, char *buf, size_t len)
+{
+	const char *password = block_take(ctx, len);
+	if (!password)
+		return -1;
+	memcpy(buf, password, len + 1);
+
+	return 0;
+}
+
+int pwgen_foreach(pwgen_ctx *ctx, pwgen_callback *cb, void *arg, size_t count, size_t len)
+{
+	for (size_t i = 0; i < count; ++i) {
+		// taken before the call, since cb may use the block as well
+		const char *password = block_take(ctx, len);
+		if (!password)
+			return -1;
+		int status = cb(password, len, arg);
+		if (status != 0)
+			return status;
+	}
+
+	return 0;
+}
@@ -0,0 +1,326 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "debug.h"
+#include "output.h"
+#include "stats.h"
+#include "uring.h"
+
+struct OutputRing { // asynchronous writes of an Output through io_uring
+	struct Uring uring;
+	char *mem;                          // the OUTPUT_RING_BUFFERS buffers, back to back
+	size_t len[OUTPUT_RING_BUFFERS];    // bytes of a buffer in flight, or 0 if it is free
+	size_t done[OUTPUT_RING_BUFFERS];   // bytes of it written so far
+	uint64_t offset[OUTPUT_RING_BUFFERS];  // where it goes in the file (unless ordered)
+	unsigned current;                   // the buffer being filled (out->buf)
+	unsigned inflight;                  // number of buffers in flight
+	int fixed;                          // the buffers are registered with the kernel
+	int ordered;                        // one write at a time, at the file position
+	uint64_t pos;                       // offset of the next buffer in the file
+	int error;                          // errno of a failed write, or 0
+};
+
+int output_init(struct Output *out, int fd, size_t size)
+{
+	assert(0 < size);
+
+	out->fd = fd;
+	out->buf = buffer_get(size * sizeof(*(out->buf)));
+	out->size = out->buf ? size : 0;
+	out->used = 0;
+	out->ring = NULL;
+
+	return out->buf ? 0 : -1;
+}
+
+int output_init_async(struct Output *out, int fd, size_t size)
+{
+	assert(0 < size);
+
+	struct OutputRing *r = buffer_get(sizeof(*r));
+	if (r)
+		r->mem = size <= SIZE_MAX / OUTPUT_RING_BUFFERS ? buffer_get(OUTPUT_RING_BUFFERS * size) : NULL;
+	if (!r || !r->mem || uring_init(&r->uring, 2 * OUTPUT_RING_BUFFERS) != 0) {
+		debug_print("no io_uring for fd %d (%s)", fd, strerror(errno));
+		if (r)
+			buffer_put(r->mem);
+		buffer_put(r);
+		return output_init(out, fd, size);
+	}
+
+	struct iovec iov[OUTPUT_RING_BUFFERS];
+	for (int k = 0; k < OUTPUT_RING_BUFFERS; ++k) {
+		iov[k].iov_base = r->mem + k * size;
+		iov[k].iov_len = size;
+	}
+	r->fixed = uring_register_buffers(&r->uring, iov, OUTPUT_RING_BUFFERS) == 0;
+
+	// only a regular file takes writes at explicit offsets in any order
+	struct stat st;
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	int flags = fcntl(fd, F_GETFL);
+	r->ordered = fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || pos < 0 || flags < 0 || (flags & O_APPEND);
+	r->pos = pos < 0 ? 0 : pos;
+	debug_print("io_uring for fd %d: %s buffers, %s writes", fd, r->fixed ? "fixed" : "plain"
+	           , r->ordered ? "ordered" : "parallel");
+
+	out->fd = fd;
+	out->buf = r->mem;
+	out->size = size;
+	out->used = 0;
+	out->ring = r;
+
+	return 0;
+}
+
+/* Queue the write of what is left of buffer k of out->ring.
+ */
+static void ring_queue(struct Output *out, unsigned k)
+{
+	struct OutputRing *r = out->ring;
+	struct io_uring_sqe *sqe = uring_get_sqe(&r->uring);
+
+	assert(sqe);  // there are twice as many entries as buffers
+	sqe->opcode = r->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = out->fd;
+	sqe->addr = (uintptr_t)(r->mem + k * out->size + r->done[k]);
+	sqe->len = r->len[k] - r->done[k];
+	sqe->off = r->ordered ? (uint64_t)-1 : r->offset[k] + r->done[k];
+	sqe->buf_index = k;
+	sqe->user_data = k;
+	stats_add(stat_writes, 1);
+}
+
+/* Submit the queued writes, wait for at least wait of them to complete, and
+ * handle the completions: finished buffers are freed, and the rest of a
+ * partial write is queued again. Return 0, or -1 if io_uring failed.
+ */
+static int ring_reap(struct Output *out, unsigned wait)
+{
+	struct OutputRing *r = out->ring;
+	struct io_uring_cqe *cqe;
+	uint64_t start = stats_clock();
+
+	if (uring_submit(&r->uring, wait) != 0)
+		return -1;
+	stats_add(stat_write_ns, stats_clock() - start);
+
+	int again = 0;
+	while ((cqe = uring_peek(&r->uring))) {
+		unsigned k = cqe->user_data;
+		int res = cqe->res;
+		uring_seen(&r->uring);
+
+		if (res > 0) {
+			r->done[k] += res;
+			stats_add(stat_bytes_written, res);
+		}
+		else if (res != -EINTR && res != -EAGAIN && !r->error)
+			r->error = res < 0 ? -res : EIO;  // nothing written is no progress either
+		if (r->done[k] < r->len[k] && !r->error) {
+			ring_queue(out, k);
+			again = 1;
+		}
+		else {
+			r->len[k] = r->done[k] = 0;
+			r->inflight--;
+		}
+	}
+
+	return again ? uring_submit(&r->uring, 0) : 0;
+}
+
+/* Hand the filled part of the current buffer to the kernel, and make out->buf
+ * an empty buffer that is not in flight. Return 0, or -1 if a write failed.
+ */
+static int ring_submit(struct Output *out)
+{
+	struct OutputRing *r = out->ring;
+
+	if (out->used > 0) {
+		while (r->ordered && r->inflight > 0 && !r->error) {
+			if (ring_reap(out, 1) != 0)
+				return -1;
+		}
+		if (!r->error) {
+			unsigned k = r->current;
+			r->len[k] = out->used;
+			r->offset[k] = r->pos;
+			r->pos += out->used;
+			r->inflight++;
+			ring_queue(out, k);
+			if (ring_reap(out, 0) != 0)
+				return -1;
+		}
+	}
+	while (r->inflight == OUTPUT_RING_BUFFERS && !r->error) {
+		if (ring_reap(out, 1) != 0)
+			return -1;
+	}
+	if (r->error) {
+		errno = r->error;
+		return -1;
+	}
+
+	unsigned k = 0;
+	while (r->len[k])
+		++k;
+	r->current = k;
+	out->buf = r->mem + k * out->size;
+	out->used = 0;
+
+	return 0;
+}
+
+char *output_reserve(struct Output *out, size_t len)
+{
+	assert(len <= out->size);
+
+	if (out->size - out->used < len && (out->ring ? ring_submit(out) : output_flush(out)) != 0)
+		return NULL;
+
+	char *rec = out->buf + out->used;
+	out->used += len;
+	return rec;
+}
+
+/* Write all of data into fd, retrying on partial writes and interrupts.
+ */
+static int write_all(int fd, const char *data, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		uint64_t start = stats_clock();
+		ssize_t n = write(fd, data + done, len - done);
+		stats_add(stat_writes, 1);
+		stats_add(stat_write_ns, stats_clock() - start);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += n;
+		stats_add(stat_bytes_written, n);
+	}
+	debug_print("wrote %zu bytes into fd %d", done, fd);
+
+	return 0;
+}
+
+int output_flush(struct Output *out)
+{
+	struct OutputRing *r = out->ring;
+
+	if (!r) {
+		if (write_all(out->fd, out->buf, out->used) != 0)
+			return -1;
+		out->used = 0;
+		return 0;
+	}
+
+	int status = ring_submit(out);
+	while (r->inflight > 0) {
+		if (ring_reap(out, 1) != 0) {
+			status = -1;
+			break;
+		}
+	}
+	if (status == 0 && r->error) {
+		errno = r->error;
+		status = -1;
+	}
+	if (!r->ordered)  // the writes at offsets leave the file position alone
+		lseek(out->fd, r->pos, SEEK_SET);
+
+	return status;
+}
+
+int output_write(struct Output *out, const char *data, size_t len)
+{
+	if (out->ring) {
+		while (len > 0) {
+			size_t n = len < out->size ? len : out->size;
+			char *p = output_reserve(out, n);
+			if (!p)
+				return -1;
+			memcpy(p, data, n);
+			data += n;
+			len -= n;
+		}
+		return 0;
+	}
+	if (output_flush(out) != 0)
+		return -1;
+
+	return write_all(out->fd, data, len);
+}
+
+int output_close(struct Output *out)
+{
+	int status = output_flush(out);
+
+	if (out->ring) {
+		if (status != 0)  // writes still in flight must not outlive the buffers
+			while (out->ring->inflight > 0 && ring_reap(out, 1) == 0)
+				;
+		uring_free(&out->ring->uring);
+		// closing the ring does not wait for its writes, so if they could
+		// not be reaped the kernel may still read the buffers: leave them be
+		if (out->ring->inflight == 0)
+			buffer_put(out->ring->mem);
+		buffer_put(out->ring);
+		out->ring = NULL;
+	}
+	else
+		buffer_put(out->buf);
+	out->buf = NULL;
+	out->size = out->used = 0;
+
+	return status;
+}
+
+char *output_map(int fd, size_t len)
+{
+	if (ftruncate(fd, len) != 0)
+		return NULL;
+	if (len == 0)  // nothing to map; any non-NULL pointer will do
+		return (char *)"";
+
+	void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+	debug_print("mapped %zu bytes of fd %d at %p", len, fd, map);
+
+	return map;
+}
+
+int output_unmap(char *map, size_t len)
+{
+	if (len == 0)
+		return 0;
+
+	return munmap(map, len);
+}
@@ -0,0 +1,124 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gensyms.h"
+#include "pattern.h"
+
+/* Return the predefined set a class character stands for, or NULL if c is
+ * not a class character.
+ */
+static const struct SymbolSet *class_set(char c)
+{
+	switch (c) {
+		case 'A': return symbol_set_find("ALPHA");
+		case 'a': return symbol_set_find("alpha");
+		case '9': return symbol_set_find("num");
+		case 'p': return symbol_set_find("punct");
+	}
+	return NULL;
+}
+
+/* Parse the next position of a pattern at *src, and advance *src past it.
+ * Return the predefined set of the position, or NULL for a literal, which
+ * is then stored into *literal. Return NULL and set *src to NULL if the
+ * source is invalid.
+ */
+static const struct SymbolSet *next_position(const char **src, char *literal)
+{
+	const char *p = *src;
+	const struct SymbolSet *set = NULL;
+
+	if (*p == '{') {
+		char name[64];
+		size_t len = strcspn(p + 1, "}");
+		if (p[1 + len] != '}' || len >= sizeof(name)) {
+			*src = NULL;
+			return NULL;
+		}
+		memcpy(name, p + 1, len);
+		name[len] = '\0';
+		if (!(set = symbol_set_find(name))) {
+			*src = NULL;
+			return NULL;
+		}
+		*src = p + len + 2;
+		return set;
+	}
+	if (*p == '\\') {
+		if (!p[1]) {
+			*src = NULL;
+			return NULL;
+		}
+		*literal = p[1];
+		*src = p + 2;
+		return NULL;
+	}
+	*src = p + 1;
+	if ((set = class_set(*p)))
+		return set;
+	*literal = *p;
+	return NULL;
+}
+
+int pattern_compile(struct Pattern *pattern, const char *src)
+{
+	char literal;
+	size_t len = 0;
+
+	memset(pattern, 0, sizeof(*pattern));
+	for (const char *p = src; *p; ++len) { // check and count the positions first
+		next_position(&p, &literal);
+		if (!p) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	if (len == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pattern->pos = calloc(len, sizeof(*pattern->pos));
+	pattern->literals = malloc(len);
+	if (!pattern->pos || !pattern->literals) {
+		pattern_free(pattern);
+		errno = ENOMEM;
+		return -1;
+	}
+	pattern->len = len;
+	for (size_t i = 0; i < len; ++i) {
+		struct PatternPosition *pos = &pattern->pos[i];
+		const struct SymbolSet *set = next_position(&src, &pattern->literals[i]);
+		if (set) {
+			pos->symbols = set->data;
+			sampler_init(&pos->sampler, set->size);
+		}
+		else {
+			pos->symbols = &pattern->literals[i];
+			sampler_init(&pos->sampler, 1);  // not drawn from (see pattern_randomize)
+		}
+	}
+
+	return 0;
+}
+
+void pattern_free(struct Pattern *pattern)
+{
+	free(pattern->pos);
+	free(pattern->literals);
+	pattern->pos = NULL;
+	pattern->literals = NULL;
+	pattern->len = 0;
+}
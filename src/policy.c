@@ -0,0 +1,87 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "gensyms.h"
+#include "policy.h"
+#include "stats.h"
+
+int policy_add(struct Policy *policy, const char *spec)
+{
+	char item[64];
+
+	for (const char *p = spec; ; ++p) {
+		size_t len = strcspn(p, ",");
+		uint32_t count = 0;
+		const struct SymbolSet *set = NULL;
+
+		if (len < sizeof(item)) {
+			memcpy(item, p, len);
+			item[len] = '\0';
+			set = symbol_set_parse(item, &count);
+		}
+		if (!set || count == 0 || POLICY_MAX_SYMBOLS - policy->required < count) {
+			errno = EINVAL;
+			return -1;
+		}
+		for (uint32_t n = 0; n < count; ++n) {
+			struct PolicySlot *slot = &policy->slots[policy->required++];
+			slot->symbols = set->data;
+			slot->size = set->size;
+		}
+
+		p += len;
+		if (!*p)
+			return 0;
+	}
+}
+
+int policy_prepare(struct Policy *policy, size_t len)
+{
+	if (policy->required > len || len > UINT32_MAX / 256) {  // sets have at most 256 symbols
+		errno = EINVAL;
+		return -1;
+	}
+	for (size_t k = 0; k < policy->required; ++k) {
+		struct PolicySlot *slot = &policy->slots[k];
+		uint32_t range = slot->size * (uint32_t)(len - policy->required + k + 1);
+		slot->bound = len - policy->required + k + 1;
+		slot->threshold = (uint32_t)-range % range;
+	}
+
+	return 0;
+}
+
+void policy_apply(const struct Policy *policy, struct RandomState *rng, char *buf,
+                  size_t count, size_t reclen, size_t len)
+{
+	assert(policy->required <= len);
+	for (size_t r = 0; r < count; ++r, buf += reclen) {
+		char *str = buf + len - policy->required;
+		for (size_t k = 0; k < policy->required; ++k, ++str) {
+			const struct PolicySlot *slot = &policy->slots[k];
+			uint64_t m, n;
+			for (;;) {
+				m = (uint64_t)rng_next(rng) * slot->size;
+				n = (uint64_t)(uint32_t)m * slot->bound;
+				if ((uint32_t)n >= slot->threshold)
+					break;
+				stats_add(stat_rejections, 1);
+			}
+			uint32_t j = n >> 32;
+			*str = buf[j];
+			buf[j] = slot->symbols[m >> 32];
+		}
+	}
+}
@@ -0,0 +1,166 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "pool.h"
+
+int pool_init(struct Pool *pool)
+{
+	memset(pool->counts, 0, sizeof(pool->counts));
+	pool->total = 0;
+	pool->symbols = NULL;
+	pool->len = 0;
+
+	return 0;
+}
+
+int pool_add(struct Pool *pool, const char *src, uint64_t weight)
+{
+	uint64_t counts[256];
+	uint64_t total = pool->total;
+	debug_print("%s(%s, %llu) pool->total=%llu", __func__, src
+	           , (unsigned long long)weight, (unsigned long long)pool->total);
+
+	// work on a copy, so that an overflow leaves the pool as it was
+	memcpy(counts, pool->counts, sizeof(counts));
+	for (const unsigned char *p = (const unsigned char *)src; *p; ++p) {
+		if (UINT64_MAX - total < weight) {
+			errno = EINVAL;
+			return -1;
+		}
+		counts[*p] += weight;
+		total += weight;
+	}
+	memcpy(pool->counts, counts, sizeof(counts));
+	pool->total = total;
+
+	return 0;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+	while (b) {
+		uint64_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+/* Return the greatest common divisor of the weights in the pool, or 0 if
+ * the pool is empty.
+ */
+static uint64_t pool_divisor(const struct Pool *pool)
+{
+	uint64_t divisor = 0;
+
+	for (int c = 0; c < 256; ++c)
+		divisor = gcd(pool->counts[c], divisor);
+	return divisor;
+}
+
+int pool_build(struct Pool *pool)
+{
+	uint64_t divisor = pool_divisor(pool);
+
+	if (divisor == 0 || pool->total / divisor > POOL_MAX_LEN) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	size_t len = pool->total / divisor;
+	char *symbols = malloc((len + 1) * sizeof(*symbols));
+	if (!symbols)
+		return -1;
+
+	char *p = symbols;
+	for (int c = 0; c < 256; ++c) {
+		memset(p, c, pool->counts[c] / divisor);
+		p += pool->counts[c] / divisor;
+	}
+	*p = '\0';
+	assert(p == symbols + len);
+
+	free(pool->symbols);
+	pool->symbols = symbols;
+	pool->len = len;
+	debug_print("built a table of %zu symbols (weights divided by %llu)", len, (unsigned long long)divisor);
+
+	return 0;
+}
+
+int pool_prepare(struct Pool *pool, struct AliasTable *alias, struct Sampler *sampler, size_t max_table)
+{
+	uint64_t divisor = pool_divisor(pool);
+
+	if (divisor == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (pool->total / divisor <= max_table) {
+		if (pool_build(pool) != 0)
+			return -1;
+		sampler_init(sampler, pool->len);
+		return 0;
+	}
+
+	uint64_t weights[256];
+	char *symbols = malloc(257 * sizeof(*symbols));
+	size_t n = 0;
+	if (!symbols)
+		return -1;
+	for (int c = 0; c < 256; ++c) {
+		if (pool->counts[c]) {
+			symbols[n] = c;
+			weights[n++] = pool->counts[c] / divisor;
+		}
+	}
+	symbols[n] = '\0';
+	if (alias_init(alias, weights, n) != 0) {
+		free(symbols);
+		errno = EINVAL;
+		return -1;
+	}
+
+	free(pool->symbols);
+	pool->symbols = symbols;
+	pool->len = n;
+	sampler_init_alias(sampler, alias, n);
+
+	return 0;
+}
+
+double pool_entropy(const struct Pool *pool)
+{
+	double h = 0;
+
+	assert(0 < pool->total);
+	for (int c = 0; c < 256; ++c) {
+		if (pool->counts[c]) {
+			double p = (double)pool->counts[c] / pool->total;
+			h -= p * log2(p);
+		}
+	}
+
+	return h;
+}
+
+void pool_free(struct Pool *pool)
+{
+	free(pool->symbols);
+	pool_init(pool);
+}
@@ -17,18 +17,36 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include <fcntl.h>
 #include <getopt.h>
-//#include <unistd.h>
+#include <unistd.h>
 
+#include "affinity.h"
+#include "buffer.h"
 #include "debug.h"
+#include "engine.h"
+#include "format.h"
 #include "gensyms.h"
-#include "llist.h"
+#include "output.h"
+#include "pattern.h"
+#include "policy.h"
+#include "pool.h"
 #include "random.h"
+#include "seed.h"
+#include "server.h"
+#include "stats.h"
+#include "unique.h"
+#include "wordlist.h"
 
 #define PROGRAM_NAME "pwgen"
 #define VERSION "0.6.0"
@@ -36,24 +54,61 @@
 #define AUTHORS "Juho Rosqvist"
 
 struct Configuration {
-	int pwcount;         // how many random passwords to generate
+	uint64_t pwcount;    // how many random passwords to generate, or 0 for no limit
 	size_t pwlen;        // the length of each generated password
-	size_t len_active_symbols;  // length of the string containing allowed characters
-	char *active_symbols;       // string of characters allowed in password generation
+	Pool pool;           // characters allowed in password generation
 	char *seed_file;     // name of the file whence the random seed is read
-	Node *symbol_sets;   // points to the root of the list of predefined symbol sets
+	size_t buffer_size;  // size of the output buffer in bytes
+	int threads;         // number of password generator threads
+	const RandomBackend *rng;  // algorithm of the pseudo-random number generator
+	char *kernel;        // name of the str_randomize kernel to use, or NULL for the fastest
+	char *serve;         // socket path to serve requests on, or NULL
+	char *client;        // socket path of the server to request from, or NULL
+	char *spec;          // pool and generator choices as a request specification
+	size_t spec_len;     // number of bytes in spec
+	char *output_file;   // name of the file to write into, or NULL for stdout
+	int mmap;            // generate straight into the memory-mapped output file
+	enum record_format format;  // layout of the output records
+	int stats;           // print the statistics counters on exit
+	char *seed_hex;      // key of the reproducible indexed mode in hexadecimal, or NULL
+	uint32_t shard;      // this run is shard number shard (from 1) of shards,
+	uint32_t shards;     // or 0 if the run is not split
+	int unique;          // never repeat a string within the run
+	char *pattern;       // source of the pattern of the strings, or NULL
+	struct Policy policy;  // symbols every string must contain
+	char *wordlist;      // word list to make passphrases of instead, or NULL
+	int write_index;     // write the index sidecar of the word list and exit
+	uint64_t bits;       // entropy to make the strings just long enough for, or 0
+	int device;          // generate on an OpenCL device
+	int affinity;        // pin the generator threads to CPUs
+	char *cpus;          // list of the CPUs to pin them to, or NULL for all
+	int numa;            // place the threads and their buffers node by node
 };
 
 #define DEFAULT_pwcount 1
 #define DEFAULT_pwlen 8
 #define DEFAULT_seed_file "/dev/urandom"
 #define DEFAULT_symbols "asciipns"
+#define DEFAULT_buffer_size (64 * 1024)
+#define DEFAULT_threads 1
+#define DEFAULT_rng rng_chacha20
 
-size_t activate_symbols(struct Configuration *conf, const char *src);
+// values for options that only have a long form (beyond any short option char)
+enum long_option { opt_buffer_size = 256, opt_threads, opt_rng, opt_kernel, opt_serve, opt_client, opt_output, opt_mmap, opt_format, opt_stream, opt_stats, opt_seed_hex, opt_shard, opt_unique, opt_pattern, opt_require, opt_wordlist, opt_write_index, opt_bits, opt_device, opt_affinity, opt_numa };
+
+size_t activate_symbols(struct Configuration *conf, const char *src, uint32_t weight);
+void append_spec(struct Configuration *conf, char type, const char *value);
 void configure(struct Configuration *conf, int argc, char **argv);
-unsigned int get_RNG_seed(char const *file_name);
+void get_RNG_seed(char const *file_name, unsigned char *key, size_t len);
+size_t parse_size(const char *str, const char *option_name);
+uint64_t parse_count(const char *str, const char *option_name);
+void parse_hex_key(const char *str, unsigned char *key, size_t len);
+void parse_shard(const char *str, uint32_t *shard, uint32_t *shards);
+uint64_t shard_start(uint64_t count, uint32_t shard, uint32_t shards);
+int run_wordlist(struct Configuration *conf, uint64_t start);
+size_t length_for_bits(uint64_t bits, double per_symbol);
 
-enum usage_flag { help, brief, full, symbol_sets, version };
+enum usage_flag { help, brief, full, symbol_sets, generators, kernel_list, formats, version };
 void usage(enum usage_flag topic, const struct Configuration *conf);
 
 
@@ -64,49 +119,411 @@ void usage(enum usage_flag topic, const struct Configuration *conf);
  */
 int main(int argc, char **argv)
 {
-	struct Configuration conf = { 0, 0, 0, NULL, NULL, NULL };
+	struct Configuration conf = { 0, 0, { { 0 }, 0, NULL, 0 }, NULL, 0, 0, NULL, NULL, NULL, NULL, NULL, 0, NULL, 0, format_text, 0, NULL, 0, 0, 0, NULL, { { { NULL, 0, 0, 0 } }, 0 }, NULL, 0, 0, 0, 0, NULL, 0 };
+
+	uint64_t start = stats_clock();
+
+	assert(symbol_set_find(DEFAULT_symbols));
+	configure(&conf, argc, argv);  // apply command options & defaults
+	double entropy = pool_entropy(&conf.pool);  // bits per symbol
+
+	if (conf.bits && !conf.wordlist) {
+		if (conf.pattern || conf.policy.required) {
+			fprintf(stderr, "%s: --bits does not go with --pattern or --require\n", PROGRAM_NAME);
+			exit(EXIT_FAILURE);
+		}
+		conf.pwlen = length_for_bits(conf.bits, entropy);
+	}
 
-	init_symbol_sets(&(conf.symbol_sets));  // predefined symbol sets
-	assert(list_seek(conf.symbol_sets, DEFAULT_symbols));
-	configure(&conf, argc, argv);           // apply command options & defaults
-	free_symbol_sets(&(conf.symbol_sets));
+	if (conf.serve) {  // runs until killed
+		server_run(conf.serve);
+		perror(PROGRAM_NAME ": --serve");
+		exit(EXIT_FAILURE);
+	}
+	if (conf.client) {
+		if (conf.pwcount == 0) {
+			fprintf(stderr, "%s: --client needs a count\n", PROGRAM_NAME);
+			exit(EXIT_FAILURE);
+		}
+		int status = client_request(conf.client, conf.spec, conf.spec_len, conf.pwlen, conf.pwcount, STDOUT_FILENO);
+		if (status != 0)
+			perror(PROGRAM_NAME ": --client");
+		buffer_release();
+		free(conf.spec);
+		pool_free(&conf.pool);
+		return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	free(conf.spec);
+	if (conf.wordlist)
+		return run_wordlist(&conf, start);
 
-	assert(conf.len_active_symbols == strlen(conf.active_symbols));
-	assert(0 < conf.len_active_symbols);
-	assert(conf.len_active_symbols <= RAND_MAX);
+	// heavily weighted pools are drawn from with an alias table, and so are
+	// pools too large to be indexed by the packed format
+	struct AliasTable alias;
+	struct Job job = { conf.pwcount, conf.pwlen, NULL, { 0, 0 }, conf.rng, { 0 }, conf.format };
+	size_t max_table = conf.format == format_packed ? FORMAT_MAX_PACKED_RANGE : POOL_ALIAS_LEN;
+	if (pool_prepare(&conf.pool, &alias, &job.sampler, max_table) != 0) {
+		if (errno == ENOMEM)
+			fprintf(stderr, "%s: memory allocation failed\n", PROGRAM_NAME);
+		else
+			fprintf(stderr, "%s: symbol weights are too large\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+	job.symbols = conf.pool.symbols;
+	assert(conf.pool.len == strlen(conf.pool.symbols));
+	assert(0 < conf.pool.len);
+	assert(conf.pool.len <= UINT32_MAX);
 
-	srand(get_RNG_seed(conf.seed_file));
+	if (conf.kernel) {
+		job.sampler.kernel = kernel_find(conf.kernel, &job.sampler);
+		if (!job.sampler.kernel) {
+			fprintf(stderr, "%s: kernel %s is not available for this pool on this CPU\n"
+			       , PROGRAM_NAME, conf.kernel);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (conf.seed_hex) { // the same passwords on any machine, thread count or shard
+		parse_hex_key(conf.seed_hex, job.key, sizeof(job.key));
+		job.indexed = 1;
+		if (!conf.kernel && !job.sampler.alias)
+			job.sampler.kernel = &kernel_batch;  // available everywhere
+	}
+	else
+		get_RNG_seed(conf.seed_file, job.key, sizeof(job.key));
 	free(conf.seed_file); conf.seed_file = NULL;
+	if (conf.shards) {
+		if (conf.pwcount == 0) {
+			fprintf(stderr, "%s: --shard needs a count\n", PROGRAM_NAME);
+			exit(EXIT_FAILURE);
+		}
+		job.first = shard_start(conf.pwcount, conf.shard - 1, conf.shards);
+		job.pwcount = shard_start(conf.pwcount, conf.shard, conf.shards) - job.first;
+	}
+	struct Pattern pattern;
+	if (conf.pattern) { // the pattern takes the place of the pool and the length
+		if (pattern_compile(&pattern, conf.pattern) != 0) {
+			if (errno == ENOMEM)
+				fprintf(stderr, "%s: memory allocation failed\n", PROGRAM_NAME);
+			else
+				fprintf(stderr, "%s: invalid pattern: %s\n", PROGRAM_NAME, conf.pattern);
+			exit(EXIT_FAILURE);
+		}
+		if (conf.format == format_packed) {
+			fprintf(stderr, "%s: --pattern does not go with --format=%s\n", PROGRAM_NAME, format_name(conf.format));
+			exit(EXIT_FAILURE);
+		}
+		job.pattern = &pattern;
+		job.pwlen = pattern.len;
+		entropy = 0;
+		for (size_t i = 0; i < pattern.len; ++i)
+			entropy += log2(pattern.pos[i].sampler.range) / pattern.len;
+	}
+	if (conf.policy.required) {
+		if (job.pattern || conf.format == format_packed) {
+			fprintf(stderr, "%s: --require does not go with --pattern or --format=%s\n", PROGRAM_NAME, format_name(format_packed));
+			exit(EXIT_FAILURE);
+		}
+		if (policy_prepare(&conf.policy, job.pwlen) != 0) {
+			fprintf(stderr, "%s: --require can not be met by strings of %zu symbols\n", PROGRAM_NAME, job.pwlen);
+			exit(EXIT_FAILURE);
+		}
+		job.policy = &conf.policy;
+	}
+	struct UniqueSet unique;
+	double expected = 0;  // duplicates expected to be drawn in the unique mode
+	if (conf.unique) {
+		// the distinct strings and their odds of repeating are counted from
+		// the pool or the pattern, which --require would not account for
+		if (job.pwcount == 0 || job.indexed || job.policy) {
+			fprintf(stderr, "%s: --unique needs a count, and does not go with --seed-hex or --require\n", PROGRAM_NAME);
+			exit(EXIT_FAILURE);
+		}
+		double n = (double)job.pwcount, distinct = 1, same = 1;
+		if (job.pattern) {
+			for (size_t i = 0; i < pattern.len; ++i) {
+				distinct *= pattern.pos[i].sampler.range;
+				same /= pattern.pos[i].sampler.range;
+			}
+		}
+		else {
+			int symbols = 0;
+			for (int c = 0; c < 256; ++c)
+				symbols += conf.pool.counts[c] != 0;
+			for (size_t i = 0; i < conf.pwlen && distinct <= n; ++i)
+				distinct *= symbols;
+			same = unique_pool_odds(conf.pool.counts, conf.pool.total, conf.pwlen);
+		}
+		if (distinct < n) {
+			fprintf(stderr, "%s: --unique: there are only %.0f distinct strings\n", PROGRAM_NAME, distinct);
+			exit(EXIT_FAILURE);
+		}
+		unsigned char key[RNG_KEY_BYTES];
+		uint64_t fingerprint_key;
+		rng_derive(job.key, UINT64_MAX, key);
+		memcpy(&fingerprint_key, key, sizeof(fingerprint_key));
+		if (unique_init(&unique, job.pwcount, fingerprint_key) != 0) {
+			fprintf(stderr, "%s: not enough memory for --unique with %llu strings\n"
+			       , PROGRAM_NAME, (unsigned long long)job.pwcount);
+			exit(EXIT_FAILURE);
+		}
+		expected = unique_expected_repeats(same, job.pwcount);
+		job.unique = &unique;
+	}
 
-	// ensure string termination by zeroing it first
-	char *password = calloc(conf.pwlen + 1, sizeof(*password));
+	int fd = STDOUT_FILENO;
+	if (conf.output_file) {
+		fd = open(conf.output_file, (conf.mmap ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0) {
+			perror(conf.output_file);
+			exit(EXIT_FAILURE);
+		}
+	}
 
-	for (int i = 0 ; i < conf.pwcount ; ++i) {
-		str_randomize(password, conf.pwlen,
-		              conf.active_symbols, conf.len_active_symbols);
-		puts(password);
+	// every password is written out as a fixed-size record (see format.h),
+	// after the header of the format
+	uint64_t count = job.pwcount;
+	int empty = conf.shards && count == 0;  // a shard of fewer strings than shards
+	size_t reclen = format_record_len(conf.format, job.pwlen, job.sampler.range);
+	if (conf.device && conf.buffer_size < DEVICE_BUFFER_SIZE)
+		conf.buffer_size = DEVICE_BUFFER_SIZE;  // small blocks would leave the device idle
+	size_t buffer_size = conf.buffer_size < reclen ? reclen : conf.buffer_size;
+	size_t block_records = reclen ? buffer_size / reclen : 1;
+	if (conf.device) {
+		if (job.indexed || job.pattern || conf.format == format_packed) {
+			fprintf(stderr, "%s: --device does not go with --seed-hex, --pattern or --format=%s\n"
+			       , PROGRAM_NAME, format_name(format_packed));
+			exit(EXIT_FAILURE);
+		}
+		job.device = device_open(job.key, job.symbols, &job.sampler, job.pwlen, reclen
+		                        , conf.format == format_text ? '\n' : '\0', block_records);
+		if (!job.device) {
+			if (errno == EINVAL)
+				fprintf(stderr, "%s: --device: the pool is too heavily weighted for the device\n", PROGRAM_NAME);
+			else
+				perror(PROGRAM_NAME ": --device");
+			exit(EXIT_FAILURE);
+		}
+		if (conf.threads < 2)
+			conf.threads = 2;  // one hands a block to the device while the writer writes another
 	}
-	free(password);
-	free(conf.active_symbols);
+	struct Affinity affinity;
+	if (conf.affinity) {
+		if (affinity_init(&affinity, conf.cpus, conf.numa, fd) != 0) {
+			if (errno == EINVAL)
+				fprintf(stderr, "%s: invalid value for --affinity, or a CPU this process may not use: %s\n"
+				       , PROGRAM_NAME, conf.cpus ? conf.cpus : "");
+			else
+				perror(PROGRAM_NAME ": --affinity");
+			exit(EXIT_FAILURE);
+		}
+		if (conf.threads < 2)
+			conf.threads = affinity.ncpus;  // one thread per CPU
+		job.affinity = &affinity;
+	}
+	char header[FORMAT_MAX_HEADER_LEN];
+	size_t header_len = format_header_len(conf.format, job.sampler.range);
+	format_header(conf.format, header, job.pwlen, count, job.symbols, job.sampler.range);
+
+	// a reader that has had enough closes the pipe, which ends the output
+	// with EPIPE (handled below) instead of killing the program
+	signal(SIGPIPE, SIG_IGN);
+	stats_add(stat_setup_ns, stats_clock() - start);
 
-	return EXIT_SUCCESS;
+	int status;
+	if (conf.mmap) { // the records go straight to their offsets in the file
+		if (count == 0 && !empty) {
+			fprintf(stderr, "%s: --mmap needs a count\n", PROGRAM_NAME);
+			exit(EXIT_FAILURE);
+		}
+		if (reclen && count > (SIZE_MAX - header_len) / reclen) {
+			fprintf(stderr, "%s: output does not fit in memory\n", PROGRAM_NAME);
+			exit(EXIT_FAILURE);
+		}
+		size_t len = header_len + count * reclen;
+		char *map = output_map(fd, len);
+		if (!map) {
+			perror(conf.output_file);
+			exit(EXIT_FAILURE);
+		}
+		memcpy(map, header, header_len);
+		status = empty ? 0 : engine_run_mapped(&job, map + header_len, block_records, conf.threads);
+		if (output_unmap(map, len) != 0)
+			status = -1;
+	}
+	else {
+		// files take several writes in flight through io_uring, where available
+		struct Output out;
+		int init = conf.output_file ? output_init_async(&out, fd, buffer_size) : output_init(&out, fd, buffer_size);
+		if (init != 0) {
+			fprintf(stderr, "%s: memory allocation failed\n", PROGRAM_NAME);
+			exit(EXIT_FAILURE);
+		}
+		status = output_write(&out, header, header_len);
+		if (status == 0 && !empty)
+			status = engine_run(&job, &out, conf.threads);
+		if (output_close(&out) != 0)
+			status = -1;
+	}
+	if (fd != STDOUT_FILENO && close(fd) != 0)
+		status = -1;
+	if (status != 0 && errno == EPIPE)
+		status = 0;  // not an error; nobody wants more passwords
+	else if (status != 0)
+		perror(PROGRAM_NAME ": output failed");
+	memset(job.key, 0, sizeof(job.key));
+	device_close(job.device);
+	pool_free(&conf.pool);
+	if (job.pattern)
+		pattern_free(&pattern);
+	if (job.unique) {
+		if (isinf(expected))
+			fprintf(stderr, "%s: --unique: drew %llu duplicates again (the strings nearly ran out)\n"
+			       , PROGRAM_NAME, (unsigned long long)unique.duplicates);
+		else
+			fprintf(stderr, "%s: --unique: drew %llu duplicates again (about %.3g expected)\n"
+			       , PROGRAM_NAME, (unsigned long long)unique.duplicates, expected);
+		unique_free(&unique);
+	}
+	buffer_release();
+	stats_add(stat_total_ns, stats_clock() - start);
+	if (conf.stats) {
+		stats_report(stderr);
+		if (!job.policy)  // which loses a little to the fixed sets
+			fprintf(stderr, "entropy:       %20.1f bits per string\n", entropy * job.pwlen);
+	}
+
+	return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* Generate the passphrases of the --wordlist mode, where -l counts words
+ * instead of symbols and the pool is not used, into stdout or the output
+ * file. Return the exit status of the program.
+ */
+int run_wordlist(struct Configuration *conf, uint64_t start)
+{
+	struct Wordlist list;
+	struct RandomState rng;
+	unsigned char key[RNG_KEY_BYTES];
+
+	if (conf->shards || conf->unique || conf->pattern || conf->policy.required || conf->mmap || conf->affinity
+	    || (conf->format != format_text && conf->format != format_nul) || conf->pwlen == 0) {
+		fprintf(stderr, "%s: --wordlist needs -l of at least 1 word and --format=text or nul, and does not go with\n"
+		        "  --shard, --unique, --pattern, --require, --mmap, --affinity or --numa\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+	if (wordlist_open(&list, conf->wordlist) != 0) {
+		if (errno == EINVAL)
+			fprintf(stderr, "%s: %s: no words, or too large for a word list\n", PROGRAM_NAME, conf->wordlist);
+		else
+			perror(conf->wordlist);
+		exit(EXIT_FAILURE);
+	}
+	pool_free(&conf->pool);
+	if (conf->bits)
+		conf->pwlen = length_for_bits(conf->bits, log2(list.count));
+	if (conf->write_index) {
+		int status = wordlist_write_index(&list, conf->wordlist);
+		if (status != 0)
+			perror(PROGRAM_NAME ": --write-index");
+		wordlist_close(&list);
+		free(conf->seed_file);
+		return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (conf->seed_hex)  // a single stream, so the same passphrases on any machine
+		parse_hex_key(conf->seed_hex, key, sizeof(key));
+	else
+		get_RNG_seed(conf->seed_file, key, sizeof(key));
+	free(conf->seed_file); conf->seed_file = NULL;
+	rng_init(&rng, conf->rng, key, 0);
+	memset(key, 0, sizeof(key));
+
+	int fd = STDOUT_FILENO;
+	if (conf->output_file) {
+		fd = open(conf->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0) {
+			perror(conf->output_file);
+			exit(EXIT_FAILURE);
+		}
+	}
+	struct Output out;
+	size_t buffer_size = conf->buffer_size > list.longest ? conf->buffer_size : list.longest + 1;
+	int init = conf->output_file ? output_init_async(&out, fd, buffer_size) : output_init(&out, fd, buffer_size);
+	if (init != 0) {
+		fprintf(stderr, "%s: memory allocation failed\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	stats_add(stat_setup_ns, stats_clock() - start);
+
+	char terminator = conf->format == format_text ? '\n' : '\0';
+	int status = wordlist_run(&list, &rng, conf->pwlen, conf->pwcount, ' ', terminator, &out);
+	if (output_close(&out) != 0)
+		status = -1;
+	if (fd != STDOUT_FILENO && close(fd) != 0)
+		status = -1;
+	if (status != 0 && errno == EPIPE)
+		status = 0;
+	else if (status != 0)
+		perror(PROGRAM_NAME ": output failed");
+	rng_wipe(&rng);
+	buffer_release();
+	double bits = log2(list.count) * conf->pwlen;
+	wordlist_close(&list);
+	stats_add(stat_total_ns, stats_clock() - start);
+	if (conf->stats) {
+		stats_report(stderr);
+		fprintf(stderr, "entropy:       %20.1f bits per passphrase\n", bits);
+	}
+
+	return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
+/* Return the least length of strings with per_symbol bits of entropy in
+ * every symbol that makes at least bits bits, or exit with an error message
+ * if the pool has no entropy at all.
+ */
+size_t length_for_bits(uint64_t bits, double per_symbol)
+{
+	if (per_symbol <= 0) {
+		fprintf(stderr, "%s: --bits: a single symbol has no entropy\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+	// a little slack, so that rounding errors never add a symbol to exact
+	// multiples such as 128 bits of 4-bit symbols
+	double len = ceil(bits / per_symbol - 1e-9);
+	if (len > SIZE_MAX / 2) {
+		fprintf(stderr, "%s: --bits: the strings would be too long\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
 
-/* Get a seed for the pseudo-random number generator from a system source.
+	return len;
+}
+
+/* Fill the len bytes of key with a seed for the pseudo-random number
+ * generator from a system source.
  *
- * Recommended source is /dev/urandom since it may not block on read,
- * unlike /dev/random. Obviously, this only works on (most) *nix systems.
+ * The default source /dev/urandom is asked through seed_random, i.e. by a
+ * getrandom(2) call where available, without opening any file. Any other
+ * file is read as it is; the generators of all threads derive their keys
+ * from this one seed.
  * Will fall back to system time (predictable) if opening the file fails.
+ * If the file holds less than len bytes, the rest of the key is zero.
  */
-unsigned int get_RNG_seed(char const *file_name)
+void get_RNG_seed(char const *file_name, unsigned char *key, size_t len)
 {
-	unsigned int rseed;
+	memset(key, 0, len);
+	if (strcmp(file_name, DEFAULT_seed_file) == 0 && seed_random(key, len) == 0)
+		return;
 
 	FILE *fp = fopen(file_name, "rb");
 	if (fp) {
-		fread(&rseed, sizeof(rseed), 1, fp);
+		size_t n = fread(key, 1, len, fp);
 		fclose(fp);
+		if (n < len)
+			fprintf(stderr, "WARNING: read only %zu of %zu random seed bytes from %s\n"
+			       , n, len, file_name);
 	}
 	else {
 		perror(file_name);
@@ -114,10 +531,100 @@ unsigned int get_RNG_seed(char const *file_name)
 		       , "WARNING: fallback: using system time as random seed"
 		       , "WARNING: system time is predictable!"
 			   );
-		rseed = time(0);
+		time_t now = time(0);
+		memcpy(key, &now, sizeof(now) < len ? sizeof(now) : len);
+	}
+}
+
+/* Parse a positive byte count with an optional binary suffix (K, M or G).
+ *
+ * An invalid or zero value is fatal, and terminates the program.
+ */
+size_t parse_size(const char *str, const char *option_name)
+{
+	char *end;
+	unsigned long long value = strtoull(str, &end, 10);
+	int shift = 0;
+
+	switch (toupper((unsigned char)*end)) {
+		case 'G': shift += 10; // fall through
+		case 'M': shift += 10; // fall through
+		case 'K': shift += 10; ++end; break;
+	}
+	if (end == str || *end != '\0' || str[0] == '-'
+	    || value == 0 || value > (SIZE_MAX >> shift)) {
+		fprintf(stderr, "%s: invalid value for %s: %s\n", PROGRAM_NAME, option_name, str);
+		exit(EXIT_FAILURE);
+	}
+
+	return value << shift;
+}
+
+/* Parse a non-negative decimal integer of up to 64 bits.
+ *
+ * An invalid value is fatal, and terminates the program.
+ */
+uint64_t parse_count(const char *str, const char *option_name)
+{
+	char *end;
+	errno = 0;
+	unsigned long long value = strtoull(str, &end, 10);
+
+	if (!isdigit((unsigned char)str[0]) || *end != '\0' || errno == ERANGE) {
+		fprintf(stderr, "%s: invalid value for %s: %s\n", PROGRAM_NAME, option_name, str);
+		exit(EXIT_FAILURE);
 	}
 
-	return rseed;
+	return value;
+}
+
+/* Parse a key of up to 2*len hexadecimal digits into the len bytes at key,
+ * padding a shorter key with zeros. An invalid key is fatal.
+ */
+void parse_hex_key(const char *str, unsigned char *key, size_t len)
+{
+	size_t n = strlen(str);
+
+	if (n == 0 || n % 2 != 0 || n > 2 * len || strspn(str, "0123456789abcdefABCDEF") != n) {
+		fprintf(stderr, "%s: invalid value for --seed-hex: %s\n", PROGRAM_NAME, str);
+		fprintf(stderr, "%s: expected an even number of hexadecimal digits, at most %zu\n"
+		       , PROGRAM_NAME, 2 * len);
+		exit(EXIT_FAILURE);
+	}
+	memset(key, 0, len);
+	for (size_t i = 0; i < n / 2; ++i) {
+		char byte[3] = { str[2 * i], str[2 * i + 1], '\0' };
+		key[i] = (unsigned char)strtoul(byte, NULL, 16);
+	}
+}
+
+/* Parse a shard specification K/N, where 1 <= K <= N. An invalid value is
+ * fatal.
+ */
+void parse_shard(const char *str, uint32_t *shard, uint32_t *shards)
+{
+	char *end;
+	errno = 0;
+	unsigned long k = strtoul(str, &end, 10);
+	unsigned long n = 0;
+
+	if (isdigit((unsigned char)str[0]) && *end == '/' && isdigit((unsigned char)end[1]))
+		n = strtoul(end + 1, &end, 10);
+	if (*end != '\0' || errno == ERANGE || k < 1 || n < k || n > UINT32_MAX) {
+		fprintf(stderr, "%s: invalid value for --shard: %s\n", PROGRAM_NAME, str);
+		exit(EXIT_FAILURE);
+	}
+	*shard = k;
+	*shards = n;
+}
+
+/* Return the number of the first password of the shard after shard number
+ * shard (from 0) of a run of count passwords split into shards shards, i.e.
+ * floor(count * shard / shards), without overflowing.
+ */
+uint64_t shard_start(uint64_t count, uint32_t shard, uint32_t shards)
+{
+	return count / shards * shard + count % shards * shard / shards;
 }
 
 /* Process the command line and set program configuration accordingly.
@@ -130,13 +637,13 @@ void configure(struct Configuration *conf, int argc, char **argv)
 	// apply defaults (symbols default is applied at the end if nothing is selected)
 	conf->pwcount = DEFAULT_pwcount;
 	conf->pwlen   = DEFAULT_pwlen;
+	conf->buffer_size = DEFAULT_buffer_size;
+	conf->threads = DEFAULT_threads;
+	conf->rng = &DEFAULT_rng;
 	conf->seed_file = malloc((strlen(DEFAULT_seed_file) + 1) * sizeof(*(conf->seed_file)));
 	strcpy(conf->seed_file, DEFAULT_seed_file);
 
-	// activate_symbols calls realloc on conf->active_symbols,
-	// so memory for the string must be allocated beforehand
-	conf->len_active_symbols = 0;
-	conf->active_symbols = calloc(conf->len_active_symbols + 1, sizeof(*(conf->active_symbols)));
+	pool_init(&conf->pool);
 
 	struct option longopts[] = {
 		// { char* name, int has_arg,       int *flag, int val },
@@ -144,6 +651,28 @@ void configure(struct Configuration *conf, int argc, char **argv)
 		{ "count",       required_argument, NULL,      'c' },
 		{ "length",      required_argument, NULL,      'l' },
 		{ "random-seed", required_argument, NULL,      'r' },
+		{ "buffer-size", required_argument, NULL,      opt_buffer_size },
+		{ "threads",     required_argument, NULL,      opt_threads },
+		{ "rng",         required_argument, NULL,      opt_rng },
+		{ "kernel",      required_argument, NULL,      opt_kernel },
+		{ "serve",       required_argument, NULL,      opt_serve },
+		{ "client",      required_argument, NULL,      opt_client },
+		{ "output",      required_argument, NULL,      opt_output },
+		{ "mmap",        no_argument,       NULL,      opt_mmap },
+		{ "format",      required_argument, NULL,      opt_format },
+		{ "stream",      no_argument,       NULL,      opt_stream },
+		{ "stats",       no_argument,       NULL,      opt_stats },
+		{ "seed-hex",    required_argument, NULL,      opt_seed_hex },
+		{ "shard",       required_argument, NULL,      opt_shard },
+		{ "unique",      no_argument,       NULL,      opt_unique },
+		{ "pattern",     required_argument, NULL,      opt_pattern },
+		{ "require",     required_argument, NULL,      opt_require },
+		{ "wordlist",    required_argument, NULL,      opt_wordlist },
+		{ "bits",        required_argument, NULL,      opt_bits },
+		{ "device",      no_argument,       NULL,      opt_device },
+		{ "affinity",    optional_argument, NULL,      opt_affinity },
+		{ "numa",        no_argument,       NULL,      opt_numa },
+		{ "write-index", no_argument,       NULL,      opt_write_index },
 		{ "help",        no_argument,       NULL,      'h' },
 		{ "version",     no_argument,       NULL,      'v' },
 		{ 0, 0, 0, 0 }
@@ -151,7 +680,9 @@ void configure(struct Configuration *conf, int argc, char **argv)
 
 	int opt;           // holds the option character returned by getopt*
 	int option_index;  // getopt_long stores the option index to longopts here
-	struct Node *p;    // list iterator
+	const struct SymbolSet *p;  // predefined symbol set
+	uint32_t weight;   // weight of the symbol set given with -S
+	uint64_t threads;  // value of --threads
 
 	// process command line options
 	while ((opt = getopt_long(argc, argv, "S:c:l:r:hv", longopts, &option_index)) != -1) {
@@ -162,9 +693,14 @@ void configure(struct Configuration *conf, int argc, char **argv)
 					exit(EXIT_SUCCESS);
 				}
 
-				p = list_seek(conf->symbol_sets, optarg);
-				if (p) {
-					activate_symbols(conf, p->data);
+				p = symbol_set_parse(optarg, &weight);
+				if (p && weight == 0) {
+					fprintf(stderr, "%s: invalid symbol set weight: %s\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				else if (p) {
+					activate_symbols(conf, p->data, weight);
+					append_spec(conf, SPEC_SET, optarg);
 				}
 				else {
 					fprintf(stderr, "%s: no such symbol set: %s\n"
@@ -175,14 +711,14 @@ void configure(struct Configuration *conf, int argc, char **argv)
 				}
 				break;
 			case 'c':
-				conf->pwcount = atoi(optarg);
+				conf->pwcount = parse_count(optarg, "--count");
 				break;
 			case 'h':
 				usage(full, conf);
 				exit(EXIT_SUCCESS);
 				break;
 			case 'l':
-				conf->pwlen = atoi(optarg);
+				conf->pwlen = parse_count(optarg, "--length");
 				break;
 			case 'r':
 				conf->seed_file = realloc(conf->seed_file, (strlen(optarg) + 1) * sizeof(*(conf->seed_file)));
@@ -199,6 +735,115 @@ void configure(struct Configuration *conf, int argc, char **argv)
 				usage(version, conf);
 				exit(EXIT_SUCCESS);
 				break;
+			case opt_buffer_size:
+				conf->buffer_size = parse_size(optarg, "--buffer-size");
+				break;
+			case opt_threads:
+				threads = parse_count(optarg, "--threads");
+				conf->threads = threads <= INT_MAX ? (int)threads : -1;
+				if (conf->threads == 0) // one thread per online CPU
+					conf->threads = sysconf(_SC_NPROCESSORS_ONLN);
+				if (conf->threads < 1) {
+					fprintf(stderr, "%s: invalid value for --threads: %s\n", PROGRAM_NAME, optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case opt_rng:
+				if (strcmp(optarg, "help") == 0) {
+					usage(generators, conf);
+					exit(EXIT_SUCCESS);
+				}
+
+				conf->rng = rng_backend_find(optarg);
+				if (!conf->rng) {
+					fprintf(stderr, "%s: no such random number generator: %s\n"
+						   , argv[0], optarg);
+					fprintf(stderr, "Try `%s --rng=help`\n", PROGRAM_NAME);
+					exit(EXIT_FAILURE);
+				}
+				append_spec(conf, SPEC_RNG, optarg);
+				break;
+			case opt_kernel:
+				if (strcmp(optarg, "help") == 0) {
+					usage(kernel_list, conf);
+					exit(EXIT_SUCCESS);
+				}
+				conf->kernel = optarg;  // looked up once the pool is known
+				break;
+			case opt_serve:
+				conf->serve = optarg;
+				break;
+			case opt_client:
+				conf->client = optarg;
+				break;
+			case opt_output:
+				conf->output_file = optarg;
+				break;
+			case opt_stream:
+				conf->pwcount = 0;
+				break;
+			case opt_mmap:
+				conf->mmap = 1;
+				break;
+			case opt_seed_hex:
+				conf->seed_hex = optarg;  // parsed once the run is set up
+				break;
+			case opt_shard:
+				parse_shard(optarg, &conf->shard, &conf->shards);
+				break;
+			case opt_pattern:
+				conf->pattern = optarg;  // compiled once the run is set up
+				break;
+			case opt_require:
+				if (policy_add(&conf->policy, optarg) != 0) {
+					fprintf(stderr, "%s: invalid requirement: %s\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case opt_device:
+				if (!OPENCL) {
+					fprintf(stderr, "%s: --device needs a build with OpenCL (make opencl)\n", argv[0]);
+					exit(EXIT_FAILURE);
+				}
+				conf->device = 1;
+				break;
+			case opt_affinity:
+				conf->affinity = 1;
+				conf->cpus = optarg;  // checked once the output is open
+				break;
+			case opt_numa:
+				conf->affinity = conf->numa = 1;
+				break;
+			case opt_bits:
+				conf->bits = parse_count(optarg, "--bits");
+				break;
+			case opt_wordlist:
+				conf->wordlist = optarg;  // mapped once the run is set up
+				break;
+			case opt_write_index:
+				conf->write_index = 1;
+				break;
+			case opt_unique:
+				conf->unique = 1;
+				break;
+			case opt_stats:
+				if (!STATS) {
+					fprintf(stderr, "%s: --stats needs a build with statistics (make stats)\n", argv[0]);
+					exit(EXIT_FAILURE);
+				}
+				conf->stats = 1;
+				break;
+			case opt_format:
+				if (strcmp(optarg, "help") == 0) {
+					usage(formats, conf);
+					exit(EXIT_SUCCESS);
+				}
+				if (format_find(optarg, &conf->format) != 0) {
+					fprintf(stderr, "%s: no such output format: %s\n", argv[0], optarg);
+					fprintf(stderr, "Try `%s --format=help`\n", PROGRAM_NAME);
+					exit(EXIT_FAILURE);
+				}
+				break;
 			case '?': // invalid option; getopt_long already printed an error message
 				usage(help, conf);
 				exit(EXIT_FAILURE);
@@ -209,43 +854,57 @@ void configure(struct Configuration *conf, int argc, char **argv)
 		}
 	}
 
+	if (conf->mmap && !conf->output_file) {
+		fprintf(stderr, "%s: --mmap needs an --output file\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if (conf->shards && !conf->seed_hex) {
+		fprintf(stderr, "%s: --shard needs --seed-hex, or the shards would not fit together\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
 	// process non-option arguments as (partial) character pool definitions
 	for (int i = optind; i < argc; ++i) {
-		activate_symbols(conf, argv[i]);
+		activate_symbols(conf, argv[i], 1);
+		append_spec(conf, SPEC_SYMBOLS, argv[i]);
 	}
-	if (conf->len_active_symbols == 0) // use default symbols if none were selected
-		activate_symbols(conf, list_seek(conf->symbol_sets, DEFAULT_symbols)->data);
+	if (conf->pool.total == 0) // use default symbols if none were selected
+		activate_symbols(conf, symbol_set_find(DEFAULT_symbols)->data, 1);
 }
 
 /* Add characters from a zero-terminated string src to the allowed symbols pool
- * conf->active_symbols (reallocating memory as needed) and update symbols count
- * conf->len_active_symbols.
- * Failing to reallocate memory is fatal, and terminates the program.
+ * conf->pool, each with the given weight. Overflowing the weights is fatal,
+ * and terminates the program.
  *
- * Return the number of characters added to conf->active_symbols.
+ * Return the number of characters added to conf->pool.
  */
-size_t activate_symbols(struct Configuration *conf, const char *src)
+size_t activate_symbols(struct Configuration *conf, const char *src, uint32_t weight)
 {
-	size_t len = strlen(src);
-	debug_print("%s(%s) len=%zu conf->len=%zu\n", __func__, src, len, conf->len_active_symbols);
-	debug_print(" before realloc:     &symbols=0x%016x      symbols={%s}", conf->active_symbols, conf->active_symbols);
-
-	char *new_symbols = realloc(conf->active_symbols, (conf->len_active_symbols + len + 1) * sizeof(*new_symbols));
-	debug_print(" after realloc:  &new_symbols=0x%016x  new_symbols={%s}", new_symbols, new_symbols);
-	if (new_symbols) {
-		strcat(new_symbols, src);
-		debug_print(" after strcat(new_symbols, src): new_symbols={%s}", new_symbols);
-		conf->len_active_symbols += len;
-		conf->active_symbols = new_symbols;
-		assert(*(conf->active_symbols + conf->len_active_symbols) == '\0');  // no +1 here!
+	if (pool_add(&conf->pool, src, weight) != 0) {
+		pool_free(&conf->pool);
+		fprintf(stderr, "%s: symbol weights are too large\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
 	}
-	else {
-		free(conf->active_symbols); // reallocation failed, so active_symbols wasn't freed
+	return strlen(src);
+}
+
+/* Append an item of the given type and value into the request specification
+ * conf->spec (see server.h), so that --client can pass on the choices made on
+ * the command line. Failing to allocate memory is fatal.
+ */
+void append_spec(struct Configuration *conf, char type, const char *value)
+{
+	size_t len = strlen(value) + 2;  // type character, value and terminator
+	char *spec = realloc(conf->spec, conf->spec_len + len);
+
+	if (!spec) {
 		fprintf(stderr, "%s: memory allocation failed\n", PROGRAM_NAME);
 		exit(EXIT_FAILURE);
 	}
-	debug_print(" end of function: len=%zu conf->len=%zu conf->active_symbols={%s}", len, conf->len_active_symbols, conf->active_symbols);
-	return len;
+	spec[conf->spec_len] = type;
+	strcpy(spec + conf->spec_len + 1, value);
+	conf->spec = spec;
+	conf->spec_len += len;
 }
 
 /* Print instructions on how to use the program.
@@ -254,7 +913,7 @@ size_t activate_symbols(struct Configuration *conf, const char *src)
  */
 void usage(enum usage_flag topic, const struct Configuration *conf)
 {
-	struct Node *p;
+	struct Sampler sampler;
 
 	switch (topic) {
 		case help:
@@ -276,28 +935,109 @@ void usage(enum usage_flag topic, const struct Configuration *conf)
 			printf("  runs as if `-S %s` option was given.\n", DEFAULT_symbols);
 
 			printf("\noptions:\n");
-			printf("  -c <N>, --count=<N>  generate <N> strings (default: %d)\n", DEFAULT_pwcount);
+			printf("  -c <N>, --count=<N>  generate <N> strings, or an endless stream if <N>\n");
+			printf("                       is 0 (default: %d)\n", DEFAULT_pwcount);
+			printf("  --stream             the same as -c 0\n");
 			printf("  -l <N>, --length=<N> each string will have <N> characters (default: %d)\n", DEFAULT_pwlen);
+			printf("  --bits=<N>           instead of -l, make the strings just long enough for\n");
+			printf("                       <N> bits of entropy, counting the weights of the\n");
+			printf("                       pool (or the words of --wordlist)\n");
 			printf("  -h, --help           print this message and exit\n");
 			printf("  -v, --version        print version and license information and exit\n");
-			printf("  -S <SET>, --symbols=<SET>\n");
+			printf("  -S <SET>[:<W>], --symbols=<SET>[:<W>]\n");
 			printf("                       append a predefined set of symbols into the\n");
-			printf("                       randomization pool. Can be used multiple times.\n");
+			printf("                       randomization pool, each symbol counted <W> times\n");
+			printf("                       (default: 1). Can be used multiple times.\n");
 			printf("                       If <SET> is `help`, display all predefined symbol\n");
 			printf("                       sets and exit.\n");
 			printf("  -r <FILE>, --random-seed=<FILE>\n");
 			printf("                       read random seed from <FILE> (default: %s)\n", DEFAULT_seed_file);
+			printf("  --buffer-size=<N>    write output in chunks of <N> bytes; K, M and G\n");
+			printf("                       suffixes are accepted (default: %dK)\n", DEFAULT_buffer_size / 1024);
+			printf("  --threads=<N>        generate with <N> threads, or one per CPU if <N>\n");
+			printf("                       is 0 (default: %d)\n", DEFAULT_threads);
+			printf("  --rng=<NAME>         use the random number generator <NAME> (default:\n");
+			printf("                       %s). If <NAME> is `help`, list generators and exit.\n", DEFAULT_rng.name);
+			printf("  --kernel=<NAME>      generate symbols with kernel <NAME> instead of the\n");
+			printf("                       fastest one. If <NAME> is `help`, list kernels and exit.\n");
+			printf("  --format=<FMT>       write the strings as records of format <FMT>\n");
+			printf("                       (default: %s). If <FMT> is `help`, list formats.\n", format_name(format_text));
+			printf("  --output=<FILE>      write the strings into <FILE> instead of stdout\n");
+			printf("  --mmap               with --output, size <FILE> up front and generate\n");
+			printf("                       the strings straight into it through a memory map\n");
+			printf("  --seed-hex=<KEY>     generate reproducibly from the key <KEY> (up to 64\n");
+			printf("                       hex digits): string i depends only on <KEY>, i and\n");
+			printf("                       the pool, not on --threads, --buffer-size or the CPU\n");
+			printf("  --shard=<K>/<N>      with --seed-hex, generate only the <K>th of <N> equal\n");
+			printf("                       parts of the -c strings; the parts concatenated in\n");
+			printf("                       order are the whole run\n");
+			printf("  --pattern=<P>        generate strings shaped by <P> instead of -l and the\n");
+			printf("                       pool: A, a, 9 and p draw an uppercase letter, a\n");
+			printf("                       lowercase letter, a digit and a punctuation character,\n");
+			printf("                       {SET} a symbol of predefined set <SET>, \\c stands\n");
+			printf("                       for c, and any other character for itself\n");
+			printf("  --require=<SET>[:<N>][,...]\n");
+			printf("                       make every string contain at least <N> (default 1)\n");
+			printf("                       symbols of predefined set <SET>, e.g. num:1,punct:1;\n");
+			printf("                       they are put into random positions among symbols\n");
+			printf("                       drawn from the pool as usual\n");
+			printf("  --wordlist=<FILE>    make passphrases of -l words from <FILE> (one word per\n");
+			printf("                       line, optionally after dice rolls and a tab) joined\n");
+			printf("                       by spaces, instead of strings of the pool\n");
+			printf("  --write-index        with --wordlist, write an index of <FILE> into\n");
+			printf("                       <FILE>%s for faster loading, and exit\n", WORDLIST_INDEX_SUFFIX);
+			printf("  --unique             never output the same string twice: repeats are\n");
+			printf("                       drawn again, and their number is reported on stderr\n");
+			printf("                       (takes 8-16 bytes of memory per string of -c; not\n");
+			printf("                       with --require)\n");
+			printf("  --stats              print counters of random words, rejections, writes\n");
+			printf("                       and time spent, and the entropy of the strings, into\n");
+			printf("                       stderr on exit (needs a build with statistics: make\n");
+			printf("                       stats)\n");
+			printf("  --device             generate on the first OpenCL GPU, in blocks of at\n");
+			printf("                       least %d MiB (needs a build with OpenCL: make opencl)\n"
+			      , DEVICE_BUFFER_SIZE / (1024 * 1024));
+			printf("  --affinity[=<CPUS>]  pin the generator threads to the CPUs of the list\n");
+			printf("                       <CPUS> (e.g. 0-3,8; default: all), one thread per\n");
+			printf("                       CPU unless --threads is more; idle threads take over\n");
+			printf("                       the blocks of busy ones\n");
+			printf("  --numa               like --affinity, but fill the NUMA node of the output\n");
+			printf("                       device first, with the writer on it, and keep the\n");
+			printf("                       buffers and the taking over of blocks within nodes\n");
+			printf("  --serve=<PATH>       run as a server answering requests on the UNIX\n");
+			printf("                       socket <PATH>, keeping generators warm between them\n");
+			printf("  --client=<PATH>      ask the server at <PATH> for the passwords instead\n");
+			printf("                       of generating them; -S, --rng and symbols are sent\n");
+			printf("                       along, the other generator options are ignored\n");
 
 			printf("\npredefined symbol sets:\n");
 			usage(symbol_sets, conf);
 			break;
 		case symbol_sets:
-			p = conf->symbol_sets;
-			while (p) {
+			for (const SymbolSet *p = predefined_sets; p->name; ++p)
 				printf("  %-10s%s\n", p->name, p->data);
-				p = p->next;
+			break;
+		case generators:
+			for (const RandomBackend *const *b = rng_backends; *b; ++b) {
+				printf("  %-10s%s\n", (*b)->name
+				      , (*b)->available() ? "" : "(not supported on this CPU)");
 			}
 			break;
+		case kernel_list:
+			sampler_init(&sampler, 1);  // smallest pool, to check only CPU support
+			for (const Kernel *const *k = kernels; *k; ++k) {
+				printf("  %-10s%s\n", (*k)->name
+				      , (*k)->available(&sampler) ? ""
+				      : *k == &kernel_alias ? "(used automatically for heavily weighted pools)"
+				      : "(not supported on this CPU)");
+			}
+			break;
+		case formats:
+			printf("  %-10s%s\n", format_name(format_text), "one string per line");
+			printf("  %-10s%s\n", format_name(format_nul), "strings terminated by a NUL character");
+			printf("  %-10s%s\n", format_name(format_raw), "strings back to back, with no separators");
+			printf("  %-10s%s\n", format_name(format_packed), "bit-packed symbol indices after a header with the pool");
+			break;
 		case version:
 			printf("%s version %s\n%s\n%s\n%s\n\nWritten by %s\n", PROGRAM_NAME, VERSION
 			      ,"License GPL-3.0-or-later <http://gnu.org/licenses/gpl.html>"
@@ -11,30 +11,515 @@
  */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "debug.h"
 #include "random.h"
 
-int rand_lt(int upper_bound)
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 uint128;
+#endif
+
+const struct RandomBackend *const rng_backends[] = {
+	&rng_chacha20, &rng_aes_ctr, &rng_xoshiro, NULL
+};
+
+const struct Kernel *const kernels[] = {
+	&kernel_alias, &kernel_avx2, &kernel_neon, &kernel_batch, &kernel_scalar, NULL
+};
+
+static uint32_t rotl32(uint32_t x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+static uint64_t rotl64(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/* Read a little-endian 64-bit integer from the 8 bytes at p.
+ */
+static uint64_t load64_le(const unsigned char *p)
+{
+	uint64_t x = 0;
+
+	for (int i = 7; i >= 0; --i)
+		x = (x << 8) | p[i];
+	return x;
+}
+
+/* Return the low half of the 128-bit product a*b and store the high half
+ * into *hi.
+ */
+static uint64_t mul64(uint64_t a, uint64_t b, uint64_t *hi)
+{
+#ifdef __SIZEOF_INT128__
+	uint128 m = (uint128)a * b;
+	*hi = (uint64_t)(m >> 64);
+	return (uint64_t)m;
+#else
+	uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+	uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+	uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+	uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+	uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+	*hi = hi_hi + (hi_lo >> 32) + (cross >> 32);
+	return (cross << 32) | (uint32_t)lo_lo;
+#endif
+}
+
+static int always_available(void)
+{
+	return 1;
+}
+
+/* ChaCha20 by Daniel J. Bernstein, see <https://cr.yp.to/chacha.html>.
+ * The generator uses the original layout of the input block: a 64-bit block
+ * counter in words 12-13, and the 64-bit stream number as the nonce in
+ * words 14-15. The keystream of every stream is 2^70 bytes long.
+ */
+
+#define CHACHA_LANES (RNG_BLOCK_WORDS / 16)  // ChaCha20 blocks per refill
+
+/* The blocks of a refill are computed side by side, one per lane, so that
+ * the compiler can keep the lanes in vector registers.
+ */
+#define CHACHA_QUARTERROUND(x, a, b, c, d) do { \
+	for (int l = 0; l < CHACHA_LANES; ++l) { \
+		x[a][l] += x[b][l]; x[d][l] = rotl32(x[d][l] ^ x[a][l], 16); \
+		x[c][l] += x[d][l]; x[b][l] = rotl32(x[b][l] ^ x[c][l], 12); \
+		x[a][l] += x[b][l]; x[d][l] = rotl32(x[d][l] ^ x[a][l],  8); \
+		x[c][l] += x[d][l]; x[b][l] = rotl32(x[b][l] ^ x[c][l],  7); \
+	} \
+} while (0)
+
+static void chacha20_init(struct RandomState *rng, const unsigned char *key, uint64_t stream)
+{
+	uint32_t *in = rng->u.chacha;
+
+	in[0] = 0x61707865; in[1] = 0x3320646e;  // "expand 32-byte k"
+	in[2] = 0x79622d32; in[3] = 0x6b206574;
+	for (int i = 0; i < 4; ++i) {
+		uint64_t k = load64_le(key + 8 * i);
+		in[4 + 2 * i] = (uint32_t)k;
+		in[5 + 2 * i] = (uint32_t)(k >> 32);
+	}
+	in[12] = in[13] = 0;
+	in[14] = (uint32_t)stream;
+	in[15] = (uint32_t)(stream >> 32);
+}
+
+static void chacha20_refill(struct RandomState *rng)
+{
+	uint32_t *in = rng->u.chacha;
+	uint32_t x[16][CHACHA_LANES];
+	uint32_t ctr[2][CHACHA_LANES];
+
+	for (int l = 0; l < CHACHA_LANES; ++l) {
+		uint64_t c = ((uint64_t)in[13] << 32 | in[12]) + l;
+		ctr[0][l] = (uint32_t)c;
+		ctr[1][l] = (uint32_t)(c >> 32);
+	}
+	for (int i = 0; i < 16; ++i) {
+		for (int l = 0; l < CHACHA_LANES; ++l)
+			x[i][l] = i == 12 || i == 13 ? ctr[i - 12][l] : in[i];
+	}
+
+	for (int i = 0; i < 10; ++i) {
+		CHACHA_QUARTERROUND(x, 0, 4,  8, 12);
+		CHACHA_QUARTERROUND(x, 1, 5,  9, 13);
+		CHACHA_QUARTERROUND(x, 2, 6, 10, 14);
+		CHACHA_QUARTERROUND(x, 3, 7, 11, 15);
+		CHACHA_QUARTERROUND(x, 0, 5, 10, 15);
+		CHACHA_QUARTERROUND(x, 1, 6, 11, 12);
+		CHACHA_QUARTERROUND(x, 2, 7,  8, 13);
+		CHACHA_QUARTERROUND(x, 3, 4,  9, 14);
+	}
+
+	for (int l = 0; l < CHACHA_LANES; ++l) {
+		uint32_t *out = rng->block + 16 * l;
+		for (int i = 0; i < 16; ++i)
+			out[i] = x[i][l] + (i == 12 || i == 13 ? ctr[i - 12][l] : in[i]);
+	}
+
+	uint64_t c = ((uint64_t)in[13] << 32 | in[12]) + CHACHA_LANES;
+	in[12] = (uint32_t)c;
+	in[13] = (uint32_t)(c >> 32);
+}
+
+const struct RandomBackend rng_chacha20 = {
+	"chacha20", always_available, chacha20_init, chacha20_refill
+};
+
+/* The generator is xoshiro256** by David Blackman and Sebastiano Vigna,
+ * see <https://prng.di.unimi.it/>. There is no stream number in its state;
+ * streams are separated by the keys rng_init derives for them, so any
+ * number of streams costs nothing.
+ */
+
+static uint64_t xoshiro_next(uint64_t *s)
+{
+	uint64_t result = rotl64(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl64(s[3], 45);
+
+	return result;
+}
+
+static void xoshiro_init(struct RandomState *rng, const unsigned char *key, uint64_t stream)
+{
+	uint64_t *s = rng->u.xoshiro;
+	(void)stream;  // already mixed into key
+
+	// scramble the key with splitmix64, which never yields an all-zero state
+	for (int i = 0; i < 4; ++i) {
+		uint64_t z = load64_le(key + 8 * i) + (i + 1) * UINT64_C(0x9e3779b97f4a7c15);
+		z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+		z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+		s[i] = z ^ (z >> 31);
+	}
+}
+
+static void xoshiro_refill(struct RandomState *rng)
+{
+	for (size_t i = 0; i < RNG_BLOCK_WORDS; i += 2) {
+		uint64_t r = xoshiro_next(rng->u.xoshiro);
+		rng->block[i] = (uint32_t)r;
+		rng->block[i + 1] = (uint32_t)(r >> 32);
+	}
+}
+
+const struct RandomBackend rng_xoshiro = {
+	"xoshiro", always_available, xoshiro_init, xoshiro_refill
+};
+
+const struct RandomBackend *rng_backend_find(const char *name)
+{
+	for (const struct RandomBackend *const *b = rng_backends; *b; ++b) {
+		if (strcmp((*b)->name, name) == 0)
+			return (*b)->available() ? *b : NULL;
+	}
+	return NULL;
+}
+
+void rng_derive(const unsigned char *master, uint64_t index, unsigned char *subkey)
+{
+	struct RandomState kdf;
+
+	chacha20_init(&kdf, master, index);
+	kdf.u.chacha[13] = UINT32_C(1) << 31;  // block 2^63, 2^69 bytes into the stream
+	chacha20_refill(&kdf);
+	for (int i = 0; i < RNG_KEY_BYTES; ++i)
+		subkey[i] = (unsigned char)(kdf.block[i / 4] >> (8 * (i % 4)));
+	rng_wipe(&kdf);
+}
+
+void rng_init(struct RandomState *rng, const struct RandomBackend *backend,
+              const unsigned char *key, uint64_t stream)
+{
+	assert(backend->available());
+
+	rng->backend = backend;
+	rng->stream = stream;
+	rng_derive(key, stream, rng->key);
+	backend->init(rng, rng->key, stream);
+	rng->pos = RNG_BLOCK_WORDS;  // generate the first block on first use
+	rng->refills = RNG_REKEY_REFILLS;
+}
+
+void rng_refill(struct RandomState *rng)
+{
+	if (--rng->refills == 0) {
+		rng_derive(rng->key, rng->stream, rng->key);
+		rng->backend->init(rng, rng->key, rng->stream);
+		rng->refills = RNG_REKEY_REFILLS;
+		debug_print("rekeyed the generator of stream %llu", (unsigned long long)rng->stream);
+	}
+	rng->backend->refill(rng);
+	rng->pos = 0;
+	stats_add(stat_rng_words, RNG_BLOCK_WORDS);
+}
+
+void rng_wipe(struct RandomState *rng)
+{
+	volatile unsigned char *p = (volatile unsigned char *)rng;
+
+	for (size_t i = 0; i < sizeof(*rng); ++i)
+		p[i] = 0;
+}
+
+int rand_lt(struct RandomState *rng, int upper_bound)
 {
-	int r;
+	uint32_t r;
+
+	assert(0 < upper_bound);
 
-	/* Since stdlib's rand() is uniformly distributed on [0,RAND_MAX],
+	/* Since rng_next() is uniformly distributed on [0,UINT32_MAX],
 	 * we use rejection sampling to ensure that the result is also
 	 * uniformly distributed on our range [0, upper_bound - 1].
 	 */
-	int reject_bound = RAND_MAX - (RAND_MAX % upper_bound);
+	uint32_t reject_bound = UINT32_MAX - (UINT32_MAX % upper_bound);
 	assert(reject_bound % upper_bound == 0);
-	while ((r = rand()) >= reject_bound);
+	while ((r = rng_next(rng)) >= reject_bound)
+		stats_add(stat_rejections, 1);
 
 	return r % upper_bound;
 }
 
-char *str_randomize(char *str, size_t char_count, const char *symbols, size_t len_symbols)
+void sampler_init(struct Sampler *sampler, uint32_t range)
+{
+	assert(0 < range);
+
+	sampler->range = range;
+	sampler->threshold = (uint32_t)-range % range;  // (2^32 - range) mod range
+
+	sampler->pow2 = (range & (range - 1)) == 0;
+	for (sampler->bits = 0; (UINT32_C(1) << sampler->bits) < range; ++sampler->bits);
+
+	// take as many digits as fit: range^batch <= 2^64
+	uint64_t prod = range;
+	for (sampler->batch = 1; range > 1 && prod <= UINT64_MAX / range; ++sampler->batch)
+		prod *= range;
+	sampler->batch_threshold = (0 - prod) % prod;  // (2^64 - prod) mod prod
+	assert(sampler->pow2 || sampler->batch <= SAMPLER_MAX_BATCH);
+	sampler->alias = NULL;
+
+	// runtime dispatch: the first available kernel is the fastest one
+	for (const struct Kernel *const *k = kernels; *k; ++k) {
+		if ((*k)->available(sampler)) {
+			sampler->kernel = *k;
+			break;
+		}
+	}
+	debug_print("range=%u pow2=%d bits=%u batch=%u kernel=%s", range, sampler->pow2
+	           , sampler->bits, sampler->batch, sampler->kernel->name);
+}
+
+int alias_init(struct AliasTable *table, const uint64_t *weights, uint32_t n)
+{
+	uint64_t scaled[256];      // weights times 2^bits, the probability left to place
+	unsigned char small[256];  // buckets with less than a full bucket left
+	unsigned char large[256];  // buckets with at least a full bucket left
+	unsigned nsmall = 0, nlarge = 0;
+	uint64_t total = 0;
+	unsigned bits, buckets;
+
+	assert(0 < n && n <= 256);
+	for (bits = 0; (1u << bits) < n; ++bits);
+	buckets = 1u << bits;
+	for (uint32_t i = 0; i < n; ++i) {
+		if (UINT64_MAX / buckets - total < weights[i])
+			return -1;
+		total += weights[i];
+	}
+	assert(0 < total);
+
+	// the buckets past n hold a symbol of weight 0, so they are all alias
+	for (unsigned i = 0; i < buckets; ++i) {
+		scaled[i] = i < n ? weights[i] * buckets : 0;
+		table->alias[i] = i;
+		if (scaled[i] < total)
+			small[nsmall++] = i;
+		else
+			large[nlarge++] = i;
+	}
+	// fill every small bucket up with a large symbol; all sums are exact,
+	// so the symbols left over at the end have exactly a full bucket
+	while (nsmall > 0 && nlarge > 0) {
+		unsigned s = small[--nsmall], l = large[--nlarge];
+		table->cut[s] = scaled[s];
+		table->alias[s] = l;
+		scaled[l] -= total - scaled[s];
+		if (scaled[l] < total)
+			small[nsmall++] = l;
+		else
+			large[nlarge++] = l;
+	}
+	assert(nsmall == 0);
+	while (nlarge > 0)
+		table->cut[large[--nlarge]] = total;
+
+	table->total = total;
+	table->bits = bits;
+	// draw from 32-bit words if that rejects less than 1/16 of them
+	table->word_bits = bits <= 28 && total <= (UINT64_C(1) << (28 - bits)) ? 32 : 64;
+	// 2^(word_bits - bits) mod total, the rejected zone of the position draw
+	unsigned width = table->word_bits - bits;
+	table->threshold = width < 64 ? ((uint64_t)1 << width) % total : (0 - total) % total;
+
+	return 0;
+}
+
+void sampler_init_alias(struct Sampler *sampler, const struct AliasTable *table, uint32_t n)
+{
+	sampler_init(sampler, n);
+	sampler->alias = table;
+	sampler->kernel = &kernel_alias;
+	debug_print("alias sampler over %u symbols with total weight %llu", n, (unsigned long long)table->total);
+}
+
+const struct Kernel *kernel_find(const char *name, const struct Sampler *sampler)
+{
+	for (const struct Kernel *const *k = kernels; *k; ++k) {
+		if (strcmp((*k)->name, name) == 0) {
+			if (sampler->alias && *k != &kernel_alias)
+				return NULL;  // the other kernels would ignore the weights
+			return (*k)->available(sampler) ? *k : NULL;
+		}
+	}
+	return NULL;
+}
+
+static int kernel_always_available(const struct Sampler *sampler)
+{
+	(void)sampler;
+	return 1;
+}
+
+static void randomize_scalar(struct RandomState *rng, char *str, size_t char_count, const char *symbols, const struct Sampler *sampler)
 {
 	for (size_t i = 0 ; i < char_count ; ++i) {
-		str[i] = symbols[rand_lt(len_symbols)];
+		str[i] = symbols[sampler_draw(sampler, rng)];
+	}
+}
+
+const struct Kernel kernel_scalar = {
+	"scalar", kernel_always_available, randomize_scalar
+};
+
+static int kernel_alias_available(const struct Sampler *sampler)
+{
+	return sampler->alias != NULL;
+}
+
+/* Fill str with weighted symbols out of one random word each (barring
+ * rejections): the top bits pick one of the 2^bits buckets, and the rest,
+ * a uniform (word_bits - bits)-bit number, is scaled into a position in the
+ * bucket by Lemire's method.
+ */
+static void randomize_alias(struct RandomState *rng, char *str, size_t char_count, const char *symbols, const struct Sampler *sampler)
+{
+	const struct AliasTable *table = sampler->alias;
+	unsigned bits = table->bits, width = table->word_bits - bits;
+	uint64_t mask = width < 64 ? ((uint64_t)1 << width) - 1 : UINT64_MAX;
+	size_t i = 0;
+
+	if (table->word_bits == 32) { // the product fits in 64 bits
+		while (i < char_count) {
+			uint32_t x = rng_next(rng);
+			uint64_t m = (x & mask) * table->total;
+			if ((m & mask) < table->threshold) {
+				stats_add(stat_rejections, 1);
+				continue;
+			}
+			uint32_t k = (uint64_t)x >> width;
+			str[i++] = symbols[(m >> width) < table->cut[k] ? k : table->alias[k]];
+		}
+		return;
 	}
+	while (i < char_count) {
+		uint64_t x = rng_next64(rng);
+		uint64_t k = bits ? x >> width : 0;
+		uint64_t hi, lo = mul64(x & mask, table->total, &hi);
+		if ((lo & mask) < table->threshold) {
+			stats_add(stat_rejections, 1);
+			continue;
+		}
+		uint64_t v = bits ? hi << bits | lo >> width : hi;  // the product shifted down by width
+		str[i++] = symbols[v < table->cut[k] ? k : table->alias[k]];
+	}
+}
+
+const struct Kernel kernel_alias = {
+	"alias", kernel_alias_available, randomize_alias
+};
+
+/* Fill str with symbols when the range is 2^bits: every bits-wide slice of a
+ * random word is a uniformly distributed index, and nothing is ever rejected.
+ */
+static void randomize_pow2(struct RandomState *rng, char *str, size_t char_count, const char *symbols, const struct Sampler *sampler)
+{
+	unsigned bits = sampler->bits;
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	size_t i = 0;
+
+	if (bits == 0) { // a single symbol; no randomness needed
+		memset(str, symbols[0], char_count);
+		return;
+	}
+	while (i < char_count) {
+		uint64_t x = rng_next64(rng);
+		for (unsigned used = bits; used <= 64 && i < char_count; used += bits) {
+			str[i++] = symbols[x & mask];
+			x >>= bits;
+		}
+	}
+}
+
+static void randomize_batch(struct RandomState *rng, char *str, size_t char_count, const char *symbols, const struct Sampler *sampler)
+{
+	uint32_t digits[SAMPLER_MAX_BATCH];
+	size_t i = 0;
+
+	while (i < char_count) {
+		uint64_t x = rng_next64(rng);
+		uint64_t hi;
+
+		for (unsigned j = 0; j < sampler->batch; ++j) {
+			x = mul64(x, sampler->range, &hi);
+			digits[j] = (uint32_t)hi;
+		}
+		if (x < sampler->batch_threshold) { // reject the whole batch
+			stats_add(stat_rejections, 1);
+			continue;
+		}
+		for (unsigned j = 0; j < sampler->batch && i < char_count; ++j)
+			str[i++] = symbols[digits[j]];
+	}
+}
+
+static void randomize_words(struct RandomState *rng, char *str, size_t char_count, const char *symbols, const struct Sampler *sampler)
+{
+	if (sampler->pow2)
+		randomize_pow2(rng, str, char_count, symbols, sampler);
+	else
+		randomize_batch(rng, str, char_count, symbols, sampler);
+}
+
+const struct Kernel kernel_batch = {
+	"batch", kernel_always_available, randomize_words
+};
+
+char *str_randomize(struct RandomState *rng, char *str, size_t char_count, const char *symbols, const struct Sampler *sampler)
+{
+	sampler->kernel->randomize(rng, str, char_count, symbols, sampler);
 
 	return str;
 }
+
+char *records_randomize(struct RandomState *rng, char *buf, size_t count, size_t len, char terminator,
+                        const char *symbols, const struct Sampler *sampler)
+{
+	/* The characters of all records are generated into the last count*len
+	 * bytes of buf, and then moved forward into place; record i never
+	 * overlaps the unread characters of the records after it.
+	 */
+	size_t reclen = len + 1;
+	char *chars = buf + count;  // == buf + count*reclen - count*len
+
+	str_randomize(rng, chars, count * len, symbols, sampler);
+	for (size_t i = 0; i < count; ++i) {
+		char *rec = buf + i * reclen;
+		memmove(rec, chars + i * len, len);
+		rec[len] = terminator;
+	}
+
+	return buf;
+}
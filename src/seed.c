@@ -0,0 +1,74 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#  include <sys/random.h>
+#endif
+
+#include "debug.h"
+#include "seed.h"
+
+/* Read the len bytes at buf from /dev/urandom.
+ */
+static int read_urandom(unsigned char *buf, size_t len)
+{
+	int fd = open("/dev/urandom", O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	while (len > 0) {
+		ssize_t n = read(fd, buf, len);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			int err = n < 0 ? errno : EIO;
+			close(fd);
+			errno = err;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return close(fd);
+}
+
+int seed_random(void *buf, size_t len)
+{
+	unsigned char *p = buf;
+
+#ifdef __linux__
+	while (len > 0) {
+		ssize_t n = getrandom(p, len, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOSYS)
+				break;  // kernel older than 3.17
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	if (len == 0)
+		return 0;
+	debug_print("getrandom is not available, reading %zu bytes from /dev/urandom", len);
+#endif
+
+	return read_urandom(p, len);
+}
@@ -0,0 +1,390 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "debug.h"
+#include "output.h"
+#include "pwgen.h"
+#include "server.h"
+
+#define CACHE_SIZE 16             // warm generator contexts kept by the server
+#define CHUNK_SIZE (64 * 1024)    // bytes of passwords generated at a time
+#define BACKLOG 64                // pending connections queued by listen(2)
+
+struct Entry { // a warm generator context and the specification it was made of
+	char *spec;
+	size_t spec_len;
+	pwgen_ctx *ctx;          // NULL if the entry is unused
+};
+
+struct Server {
+	pthread_mutex_t lock;    // protects cache and victim
+	struct Entry cache[CACHE_SIZE];
+	unsigned victim;         // entry to evict next when the cache is full
+};
+
+struct Connection {
+	struct Server *server;
+	int fd;
+};
+
+/* Read exactly len bytes from fd into buf, retrying on partial reads and
+ * interrupts. Return 1 on success, 0 on end of file before any byte was
+ * read, or -1 on error or a truncated read (errno is set).
+ */
+static int read_full(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t n = read(fd, (char *)buf + done, len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0) {
+			if (done == 0)
+				return 0;
+			errno = EIO;
+			return -1;
+		}
+		done += n;
+	}
+
+	return 1;
+}
+
+/* Like read_full, but also treat end of file as an error (with errno EIO),
+ * since the client always expects a reply. Return 0 on success, or -1.
+ */
+static int receive(int fd, void *buf, size_t len)
+{
+	int status = read_full(fd, buf, len);
+	if (status == 0)
+		errno = EIO;
+
+	return status == 1 ? 0 : -1;
+}
+
+/* Create a generator context for the specification of spec_len bytes at
+ * spec (see server.h). Return NULL on failure (errno is set).
+ */
+static pwgen_ctx *context_new(const char *spec, size_t spec_len)
+{
+	pwgen_ctx *ctx = pwgen_new();
+	if (!ctx)
+		return NULL;
+
+	for (const char *item = spec; item < spec + spec_len; item += strlen(item) + 1) {
+		int status;
+		switch (item[0]) {
+			case SPEC_SET:
+				status = pwgen_add_set(ctx, item + 1);
+				break;
+			case SPEC_SYMBOLS:
+				status = pwgen_add_symbols(ctx, item + 1);
+				break;
+			case SPEC_RNG:
+				status = pwgen_set_rng(ctx, item + 1);
+				break;
+			default:
+				errno = EINVAL;
+				status = -1;
+		}
+		if (status != 0) {
+			int err = errno;
+			pwgen_free(ctx);
+			errno = err;
+			return NULL;
+		}
+	}
+
+	return ctx;
+}
+
+/* Take the warm context made of spec out of the cache, or create a new one
+ * if there is none. Contexts are used by one connection at a time, so two
+ * clients asking for the same pool at once simply get a context each.
+ */
+static pwgen_ctx *context_get(struct Server *s, const char *spec, size_t spec_len)
+{
+	pwgen_ctx *ctx = NULL;
+
+	pthread_mutex_lock(&s->lock);
+	for (int i = 0; i < CACHE_SIZE; ++i) {
+		struct Entry *e = &s->cache[i];
+		if (e->ctx && e->spec_len == spec_len && memcmp(e->spec, spec, spec_len) == 0) {
+			ctx = e->ctx;
+			e->ctx = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+	debug_print("%s context for a spec of %zu bytes", ctx ? "reusing" : "creating", spec_len);
+
+	return ctx ? ctx : context_new(spec, spec_len);
+}
+
+/* Return ctx into the cache, evicting an older context if the cache is full.
+ */
+static void context_put(struct Server *s, const char *spec, size_t spec_len, pwgen_ctx *ctx)
+{
+	char *copy = malloc(spec_len + 1);
+	if (!copy) {
+		pwgen_free(ctx);
+		return;
+	}
+	memcpy(copy, spec, spec_len);
+
+	pthread_mutex_lock(&s->lock);
+	struct Entry *e = NULL;
+	for (int i = 0; i < CACHE_SIZE && !e; ++i) {
+		if (!s->cache[i].ctx)
+			e = &s->cache[i];
+	}
+	if (!e)
+		e = &s->cache[s->victim++ % CACHE_SIZE];
+	pwgen_ctx *old_ctx = e->ctx;
+	char *old_spec = e->spec;
+	e->spec = copy;
+	e->spec_len = spec_len;
+	e->ctx = ctx;
+	pthread_mutex_unlock(&s->lock);
+
+	pwgen_free(old_ctx);
+	free(old_spec);
+}
+
+/* Generate count passwords of pwlen symbols with ctx into out, a chunk at
+ * a time. Return 0 on success, or -1 if writing failed.
+ */
+static int send_passwords(struct Output *out, pwgen_ctx *ctx, size_t pwlen, uint64_t count)
+{
+	size_t reclen = pwlen + 1;
+	size_t chunk = out->size / reclen;
+
+	while (count > 0) {
+		size_t n = count < chunk ? count : chunk;
+		char *buf = output_reserve(out, n * reclen);
+		if (!buf || pwgen_fill(ctx, buf, n, pwlen) != 0)
+			return -1;
+		for (size_t i = 1; i <= n; ++i)  // records are zero-terminated by pwgen_fill
+			buf[i * reclen - 1] = '\n';
+		count -= n;
+	}
+
+	return output_flush(out);
+}
+
+/* Answer requests from one client until it hangs up or breaks the protocol.
+ */
+static void *serve_connection(void *arg)
+{
+	struct Connection conn = *(struct Connection *)arg;
+	struct Output out = { conn.fd, NULL, 0, 0, NULL };
+	struct Request req;
+	char *spec = NULL;
+	free(arg);
+
+	while (read_full(conn.fd, &req, sizeof(req)) == 1) {
+		if (req.magic != REQUEST_MAGIC || req.spec_len > REQUEST_MAX_SPEC)
+			break;  // can not tell where the next request would start
+		char *p = realloc(spec, req.spec_len + 1);
+		if (!p)
+			break;
+		spec = p;
+		if (read_full(conn.fd, spec, req.spec_len) != 1)
+			break;
+		spec[req.spec_len] = '\0';  // terminates a malformed last item
+
+		size_t reclen = (size_t)req.pwlen + 1;
+		if (out.size < reclen) {
+			size_t size = reclen < CHUNK_SIZE ? CHUNK_SIZE : reclen;
+			output_close(&out);
+			if (output_init_async(&out, conn.fd, size) != 0)
+				break;
+		}
+
+		Reply reply = { 0, 0, 0 };
+		pwgen_ctx *ctx = NULL;
+		if (req.pwlen > REQUEST_MAX_PWLEN || req.count > UINT64_MAX / reclen)
+			reply.status = EINVAL;
+		else if (!(ctx = context_get(conn.server, spec, req.spec_len)))
+			reply.status = errno;
+		else
+			reply.length = req.count * reclen;
+
+		// the reply header goes into the buffer with the first passwords
+		char *header = output_reserve(&out, sizeof(reply));
+		int status = header ? 0 : -1;
+		if (header)
+			memcpy(header, &reply, sizeof(reply));
+		if (status == 0 && ctx)
+			status = send_passwords(&out, ctx, req.pwlen, req.count);
+		else if (status == 0)
+			status = output_flush(&out);
+		if (ctx)
+			context_put(conn.server, spec, req.spec_len, ctx);
+		if (status != 0)
+			break;
+	}
+
+	output_close(&out);
+	buffer_release();  // the pool goes away with the thread
+	close(conn.fd);
+	free(spec);
+	return NULL;
+}
+
+/* Create a UNIX stream socket bound to path, replacing a stale socket.
+ * Return the socket, or -1 on error (errno is set).
+ */
+static int socket_bind(const char *path, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);  // left over from an earlier server; never remove anything else
+	if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) != 0 || listen(fd, BACKLOG) != 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	return fd;
+}
+
+int server_run(const char *path)
+{
+	struct Server server = { PTHREAD_MUTEX_INITIALIZER, { { NULL, 0, NULL } }, 0 };
+	struct sockaddr_un addr;
+	pthread_attr_t attr;
+
+	int fd = socket_bind(path, &addr);
+	if (fd < 0)
+		return -1;
+	signal(SIGPIPE, SIG_IGN);  // a client hanging up must not kill the server
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	debug_print("serving on %s", path);
+
+	for (;;) {
+		int client = accept(fd, NULL, NULL);
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+
+		pthread_t thread;
+		struct Connection *conn = malloc(sizeof(*conn));
+		if (conn) {
+			conn->server = &server;
+			conn->fd = client;
+		}
+		if (!conn || pthread_create(&thread, &attr, serve_connection, conn) != 0) {
+			free(conn);
+			close(client);
+		}
+	}
+
+	// connection threads may still use the cache, so it is deliberately not freed
+	int err = errno;
+	pthread_attr_destroy(&attr);
+	close(fd);
+	errno = err;
+	return -1;
+}
+
+int client_request(const char *path, const char *spec, size_t spec_len,
+                   size_t pwlen, uint64_t count, int fd)
+{
+	struct sockaddr_un addr;
+	struct Output out;
+	Request req = { REQUEST_MAGIC, pwlen, count, spec_len, 0 };
+	Reply reply;
+
+	if (pwlen > REQUEST_MAX_PWLEN || spec_len > REQUEST_MAX_SPEC) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+	    || output_init(&out, sock, sizeof(req) + spec_len) != 0) {
+		int err = errno;
+		close(sock);
+		errno = err;
+		return -1;
+	}
+
+	// send the request in one write, then relay the reply
+	memcpy(output_reserve(&out, sizeof(req)), &req, sizeof(req));
+	if (spec_len)
+		memcpy(output_reserve(&out, spec_len), spec, spec_len);
+	int status = output_close(&out);
+	if (status == 0 && receive(sock, &reply, sizeof(reply)) != 0)
+		status = -1;
+	if (status == 0 && reply.status != 0) {
+		errno = reply.status;
+		status = -1;
+	}
+	if (status == 0 && (status = output_init(&out, fd, CHUNK_SIZE)) == 0) {
+		for (uint64_t left = reply.length; left > 0 && status == 0; ) {
+			size_t n = left < out.size ? left : out.size;
+			char *buf = output_reserve(&out, n);
+			status = buf ? receive(sock, buf, n) : -1;
+			left -= n;
+		}
+		if (output_close(&out) != 0)
+			status = -1;
+	}
+
+	int err = errno;
+	close(sock);
+	errno = err;
+	return status;
+}
@@ -0,0 +1,244 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "debug.h"
+#include "random.h"
+
+/* Vectorized kernels for str_randomize.
+ *
+ * Each random byte is masked to its low sampler->bits bits, which gives a
+ * uniformly distributed index into [0, 2^bits - 1]; indices beyond the pool
+ * are rejected, so the accepted ones are uniform on [0, range - 1]. The pool
+ * (at most 128 symbols) is kept in 16-byte table registers, and the indices
+ * are mapped to symbols by byte shuffles. Since more than half of the indices
+ * are always accepted, this costs at most two random bytes per symbol.
+ *
+ * The x86 kernels are compiled for their target regardless of the compiler
+ * flags, and their availability is checked at run time.
+ */
+
+#define KERNEL_MAX_RANGE 128
+
+static int kernel_unavailable(const struct Sampler *sampler)
+{
+	(void)sampler;
+	return 0;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+#define AVX2_TARGET __attribute__((target("avx2,popcnt")))
+
+/* Shuffle control for left-packing 8 bytes: entry m moves the bytes whose
+ * bits are set in m to the front, in order, and zeroes the rest.
+ */
+static const uint64_t pack_lut[256] = {
+	UINT64_C(0x8080808080808080), UINT64_C(0x8080808080808000), UINT64_C(0x8080808080808001), UINT64_C(0x8080808080800100),
+	UINT64_C(0x8080808080808002), UINT64_C(0x8080808080800200), UINT64_C(0x8080808080800201), UINT64_C(0x8080808080020100),
+	UINT64_C(0x8080808080808003), UINT64_C(0x8080808080800300), UINT64_C(0x8080808080800301), UINT64_C(0x8080808080030100),
+	UINT64_C(0x8080808080800302), UINT64_C(0x8080808080030200), UINT64_C(0x8080808080030201), UINT64_C(0x8080808003020100),
+	UINT64_C(0x8080808080808004), UINT64_C(0x8080808080800400), UINT64_C(0x8080808080800401), UINT64_C(0x8080808080040100),
+	UINT64_C(0x8080808080800402), UINT64_C(0x8080808080040200), UINT64_C(0x8080808080040201), UINT64_C(0x8080808004020100),
+	UINT64_C(0x8080808080800403), UINT64_C(0x8080808080040300), UINT64_C(0x8080808080040301), UINT64_C(0x8080808004030100),
+	UINT64_C(0x8080808080040302), UINT64_C(0x8080808004030200), UINT64_C(0x8080808004030201), UINT64_C(0x8080800403020100),
+	UINT64_C(0x8080808080808005), UINT64_C(0x8080808080800500), UINT64_C(0x8080808080800501), UINT64_C(0x8080808080050100),
+	UINT64_C(0x8080808080800502), UINT64_C(0x8080808080050200), UINT64_C(0x8080808080050201), UINT64_C(0x8080808005020100),
+	UINT64_C(0x8080808080800503), UINT64_C(0x8080808080050300), UINT64_C(0x8080808080050301), UINT64_C(0x8080808005030100),
+	UINT64_C(0x8080808080050302), UINT64_C(0x8080808005030200), UINT64_C(0x8080808005030201), UINT64_C(0x8080800503020100),
+	UINT64_C(0x8080808080800504), UINT64_C(0x8080808080050400), UINT64_C(0x8080808080050401), UINT64_C(0x8080808005040100),
+	UINT64_C(0x8080808080050402), UINT64_C(0x8080808005040200), UINT64_C(0x8080808005040201), UINT64_C(0x8080800504020100),
+	UINT64_C(0x8080808080050403), UINT64_C(0x8080808005040300), UINT64_C(0x8080808005040301), UINT64_C(0x8080800504030100),
+	UINT64_C(0x8080808005040302), UINT64_C(0x8080800504030200), UINT64_C(0x8080800504030201), UINT64_C(0x8080050403020100),
+	UINT64_C(0x8080808080808006), UINT64_C(0x8080808080800600), UINT64_C(0x8080808080800601), UINT64_C(0x8080808080060100),
+	UINT64_C(0x8080808080800602), UINT64_C(0x8080808080060200), UINT64_C(0x8080808080060201), UINT64_C(0x8080808006020100),
+	UINT64_C(0x8080808080800603), UINT64_C(0x8080808080060300), UINT64_C(0x8080808080060301), UINT64_C(0x8080808006030100),
+	UINT64_C(0x8080808080060302), UINT64_C(0x8080808006030200), UINT64_C(0x8080808006030201), UINT64_C(0x8080800603020100),
+	UINT64_C(0x8080808080800604), UINT64_C(0x8080808080060400), UINT64_C(0x8080808080060401), UINT64_C(0x8080808006040100),
+	UINT64_C(0x8080808080060402), UINT64_C(0x8080808006040200), UINT64_C(0x8080808006040201), UINT64_C(0x8080800604020100),
+	UINT64_C(0x8080808080060403), UINT64_C(0x8080808006040300), UINT64_C(0x8080808006040301), UINT64_C(0x8080800604030100),
+	UINT64_C(0x8080808006040302), UINT64_C(0x8080800604030200), UINT64_C(0x8080800604030201), UINT64_C(0x8080060403020100),
+	UINT64_C(0x8080808080800605), UINT64_C(0x8080808080060500), UINT64_C(0x8080808080060501), UINT64_C(0x8080808006050100),
+	UINT64_C(0x8080808080060502), UINT64_C(0x8080808006050200), UINT64_C(0x8080808006050201), UINT64_C(0x8080800605020100),
+	UINT64_C(0x8080808080060503), UINT64_C(0x8080808006050300), UINT64_C(0x8080808006050301), UINT64_C(0x8080800605030100),
+	UINT64_C(0x8080808006050302), UINT64_C(0x8080800605030200), UINT64_C(0x8080800605030201), UINT64_C(0x8080060503020100),
+	UINT64_C(0x8080808080060504), UINT64_C(0x8080808006050400), UINT64_C(0x8080808006050401), UINT64_C(0x8080800605040100),
+	UINT64_C(0x8080808006050402), UINT64_C(0x8080800605040200), UINT64_C(0x8080800605040201), UINT64_C(0x8080060504020100),
+	UINT64_C(0x8080808006050403), UINT64_C(0x8080800605040300), UINT64_C(0x8080800605040301), UINT64_C(0x8080060504030100),
+	UINT64_C(0x8080800605040302), UINT64_C(0x8080060504030200), UINT64_C(0x8080060504030201), UINT64_C(0x8006050403020100),
+	UINT64_C(0x8080808080808007), UINT64_C(0x8080808080800700), UINT64_C(0x8080808080800701), UINT64_C(0x8080808080070100),
+	UINT64_C(0x8080808080800702), UINT64_C(0x8080808080070200), UINT64_C(0x8080808080070201), UINT64_C(0x8080808007020100),
+	UINT64_C(0x8080808080800703), UINT64_C(0x8080808080070300), UINT64_C(0x8080808080070301), UINT64_C(0x8080808007030100),
+	UINT64_C(0x8080808080070302), UINT64_C(0x8080808007030200), UINT64_C(0x8080808007030201), UINT64_C(0x8080800703020100),
+	UINT64_C(0x8080808080800704), UINT64_C(0x8080808080070400), UINT64_C(0x8080808080070401), UINT64_C(0x8080808007040100),
+	UINT64_C(0x8080808080070402), UINT64_C(0x8080808007040200), UINT64_C(0x8080808007040201), UINT64_C(0x8080800704020100),
+	UINT64_C(0x8080808080070403), UINT64_C(0x8080808007040300), UINT64_C(0x8080808007040301), UINT64_C(0x8080800704030100),
+	UINT64_C(0x8080808007040302), UINT64_C(0x8080800704030200), UINT64_C(0x8080800704030201), UINT64_C(0x8080070403020100),
+	UINT64_C(0x8080808080800705), UINT64_C(0x8080808080070500), UINT64_C(0x8080808080070501), UINT64_C(0x8080808007050100),
+	UINT64_C(0x8080808080070502), UINT64_C(0x8080808007050200), UINT64_C(0x8080808007050201), UINT64_C(0x8080800705020100),
+	UINT64_C(0x8080808080070503), UINT64_C(0x8080808007050300), UINT64_C(0x8080808007050301), UINT64_C(0x8080800705030100),
+	UINT64_C(0x8080808007050302), UINT64_C(0x8080800705030200), UINT64_C(0x8080800705030201), UINT64_C(0x8080070503020100),
+	UINT64_C(0x8080808080070504), UINT64_C(0x8080808007050400), UINT64_C(0x8080808007050401), UINT64_C(0x8080800705040100),
+	UINT64_C(0x8080808007050402), UINT64_C(0x8080800705040200), UINT64_C(0x8080800705040201), UINT64_C(0x8080070504020100),
+	UINT64_C(0x8080808007050403), UINT64_C(0x8080800705040300), UINT64_C(0x8080800705040301), UINT64_C(0x8080070504030100),
+	UINT64_C(0x8080800705040302), UINT64_C(0x8080070504030200), UINT64_C(0x8080070504030201), UINT64_C(0x8007050403020100),
+	UINT64_C(0x8080808080800706), UINT64_C(0x8080808080070600), UINT64_C(0x8080808080070601), UINT64_C(0x8080808007060100),
+	UINT64_C(0x8080808080070602), UINT64_C(0x8080808007060200), UINT64_C(0x8080808007060201), UINT64_C(0x8080800706020100),
+	UINT64_C(0x8080808080070603), UINT64_C(0x8080808007060300), UINT64_C(0x8080808007060301), UINT64_C(0x8080800706030100),
+	UINT64_C(0x8080808007060302), UINT64_C(0x8080800706030200), UINT64_C(0x8080800706030201), UINT64_C(0x8080070603020100),
+	UINT64_C(0x8080808080070604), UINT64_C(0x8080808007060400), UINT64_C(0x8080808007060401), UINT64_C(0x8080800706040100),
+	UINT64_C(0x8080808007060402), UINT64_C(0x8080800706040200), UINT64_C(0x8080800706040201), UINT64_C(0x8080070604020100),
+	UINT64_C(0x8080808007060403), UINT64_C(0x8080800706040300), UINT64_C(0x8080800706040301), UINT64_C(0x8080070604030100),
+	UINT64_C(0x8080800706040302), UINT64_C(0x8080070604030200), UINT64_C(0x8080070604030201), UINT64_C(0x8007060403020100),
+	UINT64_C(0x8080808080070605), UINT64_C(0x8080808007060500), UINT64_C(0x8080808007060501), UINT64_C(0x8080800706050100),
+	UINT64_C(0x8080808007060502), UINT64_C(0x8080800706050200), UINT64_C(0x8080800706050201), UINT64_C(0x8080070605020100),
+	UINT64_C(0x8080808007060503), UINT64_C(0x8080800706050300), UINT64_C(0x8080800706050301), UINT64_C(0x8080070605030100),
+	UINT64_C(0x8080800706050302), UINT64_C(0x8080070605030200), UINT64_C(0x8080070605030201), UINT64_C(0x8007060503020100),
+	UINT64_C(0x8080808007060504), UINT64_C(0x8080800706050400), UINT64_C(0x8080800706050401), UINT64_C(0x8080070605040100),
+	UINT64_C(0x8080800706050402), UINT64_C(0x8080070605040200), UINT64_C(0x8080070605040201), UINT64_C(0x8007060504020100),
+	UINT64_C(0x8080800706050403), UINT64_C(0x8080070605040300), UINT64_C(0x8080070605040301), UINT64_C(0x8007060504030100),
+	UINT64_C(0x8080070605040302), UINT64_C(0x8007060504030200), UINT64_C(0x8007060504030201), UINT64_C(0x0706050403020100),
+};
+
+static int avx2_available(const struct Sampler *sampler)
+{
+	__builtin_cpu_init();
+	return sampler->range <= KERNEL_MAX_RANGE
+	    && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+}
+
+AVX2_TARGET static void randomize_avx2(struct RandomState *rng, char *str, size_t char_count, const char *symbols, const struct Sampler *sampler)
+{
+	unsigned char pool[KERNEL_MAX_RANGE] = { 0 };
+	__m256i table[KERNEL_MAX_RANGE / 16];
+	int ntables = (sampler->range + 15) / 16;
+
+	memcpy(pool, symbols, sampler->range);
+	for (int t = 0; t < ntables; ++t)  // the same table in both 128-bit lanes
+		table[t] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(pool + 16 * t)));
+
+	const __m256i mask = _mm256_set1_epi8((char)((1u << sampler->bits) - 1));
+	const __m256i bound = _mm256_set1_epi8((char)sampler->range);  // unused if pow2
+	const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+	unsigned char mapped[32];
+	char tail[32];
+	size_t i = 0;
+
+	while (i < char_count) {
+		__m256i idx = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)rng_words(rng, 8)), mask);
+		uint32_t accept = sampler->pow2 ? UINT32_MAX
+		                : (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(bound, idx));
+		if (accept != UINT32_MAX)
+			stats_add(stat_rejections, 32 - __builtin_popcount(accept));
+
+		// pshufb looks at the low nibble; the high nibble selects the table
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(idx, 4), low_nibble);
+		__m256i sym = _mm256_shuffle_epi8(table[0], idx);
+		for (int t = 1; t < ntables; ++t) {
+			__m256i sel = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8((char)t));
+			sym = _mm256_blendv_epi8(sym, _mm256_shuffle_epi8(table[t], idx), sel);
+		}
+		_mm256_storeu_si256((__m256i *)mapped, sym);
+
+		// left-pack the accepted symbols 8 bytes at a time; every group
+		// store may write up to 8 bytes, i.e. never past 32 bytes in total
+		char *dst = char_count - i >= 32 ? str + i : tail;
+		size_t n = 0;
+		for (int g = 0; g < 4; ++g) {
+			unsigned m = (accept >> (8 * g)) & 0xff;
+			__m128i group = _mm_loadl_epi64((const __m128i *)(mapped + 8 * g));
+			group = _mm_shuffle_epi8(group, _mm_loadl_epi64((const __m128i *)(pack_lut + m)));
+			_mm_storel_epi64((__m128i *)(dst + n), group);
+			n += __builtin_popcount(m);
+		}
+		if (dst == tail) {
+			n = n < char_count - i ? n : char_count - i;
+			memcpy(str + i, tail, n);
+		}
+		i += n;
+	}
+}
+
+const struct Kernel kernel_avx2 = {
+	"avx2", avx2_available, randomize_avx2
+};
+
+#else // not x86
+
+const struct Kernel kernel_avx2 = {
+	"avx2", kernel_unavailable, NULL
+};
+
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+static int neon_available(const struct Sampler *sampler)
+{
+	return sampler->range <= KERNEL_MAX_RANGE;  // NEON is part of AArch64
+}
+
+static void randomize_neon(struct RandomState *rng, char *str, size_t char_count, const char *symbols, const struct Sampler *sampler)
+{
+	uint8_t pool[KERNEL_MAX_RANGE] = { 0 };
+	uint8x16x4_t lo, hi;  // symbols 0..63 and 64..127
+
+	memcpy(pool, symbols, sampler->range);
+	for (int t = 0; t < 4; ++t) {
+		lo.val[t] = vld1q_u8(pool + 16 * t);
+		hi.val[t] = vld1q_u8(pool + 64 + 16 * t);
+	}
+
+	const uint8x16_t mask = vdupq_n_u8((uint8_t)((1u << sampler->bits) - 1));
+	const uint8x16_t bound = vdupq_n_u8((uint8_t)(sampler->pow2 ? 255 : sampler->range));
+	const uint8x16_t offset = vdupq_n_u8(64);
+	uint8_t mapped[16], accept[16];
+	size_t i = 0;
+
+	while (i < char_count) {
+		uint8x16_t idx = vandq_u8(vld1q_u8((const uint8_t *)rng_words(rng, 4)), mask);
+
+		// out-of-table indices give 0 (tbl) or keep the old value (tbx)
+		uint8x16_t sym = vqtbl4q_u8(lo, idx);
+		sym = vqtbx4q_u8(sym, hi, vsubq_u8(idx, offset));
+		uint8x16_t ok = sampler->pow2 ? vdupq_n_u8(0xff) : vcltq_u8(idx, bound);
+
+		vst1q_u8(mapped, sym);
+		vst1q_u8(accept, ok);
+		if (STATS && !sampler->pow2) {
+			unsigned rejected = 0;
+			for (int k = 0; k < 16; ++k)
+				rejected += !(accept[k] & 1);
+			stats_add(stat_rejections, rejected);
+		}
+		for (int k = 0; k < 16 && i < char_count; ++k) {
+			str[i] = (char)mapped[k];
+			i += accept[k] & 1;
+		}
+	}
+}
+
+const struct Kernel kernel_neon = {
+	"neon", neon_available, randomize_neon
+};
+
+#else // not AArch64
+
+const struct Kernel kernel_neon = {
+	"neon", kernel_unavailable, NULL
+};
+
+#endif
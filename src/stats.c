@@ -0,0 +1,56 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "stats.h"
+
+uint64_t stats[stat_counters];
+
+uint64_t stats_clock(void)
+{
+	struct timespec ts;
+
+	if (!STATS || clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Return the value of counter, divided by what (or 0 if what is 0).
+ */
+static double ratio(enum stat_counter counter, double what)
+{
+	return what > 0 ? __atomic_load_n(&stats[counter], __ATOMIC_RELAXED) / what : 0;
+}
+
+void stats_report(FILE *f)
+{
+	uint64_t s[stat_counters];
+
+	for (int i = 0; i < stat_counters; ++i)
+		s[i] = __atomic_load_n(&stats[i], __ATOMIC_RELAXED);
+
+	fprintf(f, "random words:  %20llu\n", (unsigned long long)s[stat_rng_words]);
+	fprintf(f, "rejections:    %20llu  (%.4f per random word)\n", (unsigned long long)s[stat_rejections]
+	       , ratio(stat_rejections, s[stat_rng_words]));
+	fprintf(f, "bytes written: %20llu  (%.1f MB/s)\n", (unsigned long long)s[stat_bytes_written]
+	       , 1e3 * ratio(stat_bytes_written, s[stat_total_ns]));
+	fprintf(f, "write calls:   %20llu  (%.0f bytes per call)\n", (unsigned long long)s[stat_writes]
+	       , ratio(stat_bytes_written, s[stat_writes]));
+	fprintf(f, "buffer allocs: %20llu  (%llu reused)\n", (unsigned long long)s[stat_buffer_allocs]
+	       , (unsigned long long)s[stat_buffer_reuses]);
+	fprintf(f, "setup time:    %20.6f s\n", s[stat_setup_ns] / 1e9);
+	fprintf(f, "generate time: %20.6f s  (all threads)\n", s[stat_generate_ns] / 1e9);
+	fprintf(f, "write time:    %20.6f s\n", s[stat_write_ns] / 1e9);
+	fprintf(f, "total time:    %20.6f s\n", s[stat_total_ns] / 1e9);
+}
@@ -0,0 +1,131 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unique.h"
+
+#define EXACT_REPEATS (1 << 20)  // up to this many strings, the expected repeats are summed
+
+int unique_init(struct UniqueSet *set, uint64_t capacity, uint64_t key)
+{
+	uint64_t slots = 2;
+
+	while (slots * UNIQUE_LOAD < capacity && slots <= SIZE_MAX / sizeof(*set->slots) / 2)
+		slots *= 2;
+	set->slots = slots * UNIQUE_LOAD < capacity ? NULL : calloc(slots, sizeof(*set->slots));
+	if (!set->slots) {
+		errno = ENOMEM;
+		return -1;
+	}
+	set->mask = slots - 1;
+	set->key = key;
+	set->duplicates = 0;
+
+	return 0;
+}
+
+/* Mix the bits of x (the finalizer of splitmix64).
+ */
+static uint64_t mix64(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return x ^ (x >> 31);
+}
+
+// the bytes are taken 8 at a time, each word mixed into the hash
+uint64_t unique_fingerprint(const struct UniqueSet *set, const char *p, size_t len)
+{
+	uint64_t h = set->key ^ (len * UINT64_C(0x9e3779b97f4a7c15));
+
+	for (; len >= 8; p += 8, len -= 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		h = mix64(h ^ w);
+	}
+	if (len > 0) {
+		uint64_t w = 0;
+		memcpy(&w, p, len);
+		h = mix64(h ^ w);
+	}
+	h = mix64(h);
+
+	return h ? h : 1;  // 0 marks an empty slot
+}
+
+int unique_add(struct UniqueSet *set, uint64_t h)
+{
+	for (uint64_t i = h & set->mask; ; i = (i + 1) & set->mask) {
+		uint64_t seen = __atomic_load_n(&set->slots[i], __ATOMIC_RELAXED);
+		if (seen == 0) {
+			if (__atomic_compare_exchange_n(&set->slots[i], &seen, h, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return 1;
+			// another thread took the slot first; seen is what it put there
+		}
+		if (seen == h) {
+			__atomic_fetch_add(&set->duplicates, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+	}
+}
+
+int unique_insert(struct UniqueSet *set, const char *rec, size_t len)
+{
+	return unique_add(set, unique_fingerprint(set, rec, len));
+}
+
+void unique_free(struct UniqueSet *set)
+{
+	free(set->slots);
+	set->slots = NULL;
+}
+
+double unique_pool_odds(const uint64_t *counts, uint64_t total, size_t pwlen)
+{
+	double same = 0;  // odds that two symbols are equal
+	double q = 1;
+
+	for (int c = 0; c < 256; ++c) {
+		double p = (double)counts[c] / total;
+		same += p * p;
+	}
+	for (size_t i = 0; i < pwlen && q > 0; ++i)
+		q *= same;
+
+	return q;
+}
+
+double unique_expected_repeats(double q, uint64_t n)
+{
+	// the k-th string (from 0) takes 1 / (1 - k*q) draws on average, i.e.
+	// k*q / (1 - k*q) repeats
+	if (n == 0 || (n - 1) * q >= 1)
+		return n == 0 ? 0 : INFINITY;
+	if (n <= EXACT_REPEATS) {
+		double sum = 0;
+		for (uint64_t k = 1; k < n; ++k)
+			sum += k * q / (1 - k * q);
+		return sum;
+	}
+
+	// beyond that, the sum as an integral over [-1/2, n - 1/2], which the
+	// midpoints k approximate closely: -n - (ln(1 - (n - 1/2)*q) - ln(1 + q/2)) / q
+	double nq = n * q;
+	if (nq < 1e-6)
+		return (double)n * (n - 1) / 2 * q;  // the same without cancellation
+	else if ((n - 0.5) * q < 1)
+		return -(double)n - (log1p(-(n - 0.5) * q) - log1p(q / 2)) / q;
+	return INFINITY;
+}
@@ -0,0 +1,144 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE  // for syscall(2) and MAP_POPULATE
+
+#include <errno.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+int uring_init(struct Uring *ring, unsigned entries)
+{
+	struct io_uring_params p;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0)
+		return -1;
+
+	ring->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) { // both rings in one mapping
+		if (ring->cq_map_len > ring->sq_map_len)
+			ring->sq_map_len = ring->cq_map_len;
+		ring->cq_map_len = 0;
+	}
+	ring->sq_map = mmap(NULL, ring->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                    ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_map = ring->sq_map;
+	if (ring->sq_map != MAP_FAILED && ring->cq_map_len)
+		ring->cq_map = mmap(NULL, ring->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		                    ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = MAP_FAILED;
+	if (ring->sq_map != MAP_FAILED && ring->cq_map != MAP_FAILED)
+		ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		                  ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		int err = errno;
+		uring_free(ring);
+		errno = err;
+		return -1;
+	}
+
+	char *sq = ring->sq_map, *cq = ring->cq_map;
+	ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+	ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	return 0;
+}
+
+int uring_register_buffers(struct Uring *ring, const struct iovec *iov, unsigned n)
+{
+	return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iov, n) < 0 ? -1 : 0;
+}
+
+struct io_uring_sqe *uring_get_sqe(struct Uring *ring)
+{
+	unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	unsigned tail = *ring->sq_tail + ring->pending;
+
+	if (tail - head > *ring->sq_mask)
+		return NULL;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[index] = index;
+	ring->pending++;
+
+	return sqe;
+}
+
+int uring_submit(struct Uring *ring, unsigned wait)
+{
+	// the entries must be visible to the kernel before the new tail is
+	unsigned tail = *ring->sq_tail + ring->pending;
+	__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+	ring->pending = 0;
+
+	// including any entries an earlier call left in the queue
+	unsigned submit = tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	while (submit > 0 || wait > 0) {
+		long n = syscall(__NR_io_uring_enter, ring->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0 && submit > 0 && wait == 0)
+			break;  // nothing taken, nothing to wait for; retried with the next call
+		submit -= n;
+		wait = 0;  // the call returns once the completions are there
+	}
+
+	return 0;
+}
+
+struct io_uring_cqe *uring_peek(struct Uring *ring)
+{
+	unsigned head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_seen(struct Uring *ring)
+{
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void uring_free(struct Uring *ring)
+{
+	if (ring->sqes && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_map && ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map)
+		munmap(ring->cq_map, ring->cq_map_len);
+	if (ring->sq_map && ring->sq_map != MAP_FAILED)
+		munmap(ring->sq_map, ring->sq_map_len);
+	if (ring->fd >= 0)
+		close(ring->fd);
+	ring->fd = -1;
+	ring->sqes = NULL;
+	ring->sq_map = ring->cq_map = NULL;
+}
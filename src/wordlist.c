@@ -0,0 +1,266 @@
+/* This file is part of pwgen.
+ * Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ * Pwgen is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pwgen.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "wordlist.h"
+
+#define INDEX_MAGIC 0x58495750u  // "PWIX" read as little-endian
+
+struct IndexHeader { // start of a sidecar file, followed by the offsets
+	uint32_t magic;      // INDEX_MAGIC
+	uint32_t count;      // number of offsets
+	uint64_t list_size;  // bytes in the list the index was built of
+	uint64_t longest;    // length of the longest word
+};
+
+/* Return the name of the sidecar of the list at path in allocated memory,
+ * or NULL (errno is set by malloc).
+ */
+static char *index_path(const char *path)
+{
+	size_t len = strlen(path);
+	char *name = malloc(len + sizeof(WORDLIST_INDEX_SUFFIX));
+
+	if (name) {
+		memcpy(name, path, len);
+		memcpy(name + len, WORDLIST_INDEX_SUFFIX, sizeof(WORDLIST_INDEX_SUFFIX));
+	}
+	return name;
+}
+
+/* Return whether the file with the status a was modified after, or in the
+ * same nanosecond as, that with the status b.
+ */
+static int modified_since(const struct stat *a, const struct stat *b)
+{
+	return a->st_mtim.tv_sec > b->st_mtim.tv_sec
+	       || (a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec >= b->st_mtim.tv_nsec);
+}
+
+/* Map the sidecar of the list at path (with the status st) into *list.
+ * Return 0 on success, or -1 if there is none, or if it is out of date or
+ * does not match the list. The length of the longest word is measured
+ * from the list rather than taken from the sidecar, which may be stale all
+ * the same (written within the resolution of the clock of the file system
+ * before the list was) and must not make wordlist_run overrun its output.
+ */
+static int map_index(struct Wordlist *list, const char *path, const struct stat *st)
+{
+	struct stat ist;
+	char *name = index_path(path);
+	int fd = name ? open(name, O_RDONLY) : -1;
+	free(name);
+	if (fd < 0)
+		return -1;
+
+	void *map = MAP_FAILED;
+	if (fstat(fd, &ist) == 0 && modified_since(&ist, st)
+	    && (size_t)ist.st_size >= sizeof(struct IndexHeader))
+		map = mmap(NULL, ist.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	const struct IndexHeader *h = map;
+	const uint32_t *offsets = (const uint32_t *)(h + 1);
+	int valid = h->magic == INDEX_MAGIC && h->list_size == list->size && h->count > 0
+	            && (ist.st_size - sizeof(*h)) / sizeof(*offsets) == h->count;
+	for (uint32_t i = 0; valid && i < h->count; ++i)
+		valid = offsets[i] < list->size;  // a broken index must not read past the list
+	if (!valid) {
+		munmap(map, ist.st_size);
+		return -1;
+	}
+	list->offsets = offsets;
+	list->count = h->count;
+	list->longest = 0;
+	for (uint32_t i = 0; i < h->count; ++i) {
+		const char *word;
+		size_t len = wordlist_word(list, i, &word);
+		if (len > list->longest)
+			list->longest = len;
+	}
+	list->index = map;
+	list->index_size = ist.st_size;
+
+	return 0;
+}
+
+/* Build the index of the mapped list *list by one pass over it. Return 0
+ * on success, or -1 with errno set.
+ */
+static int build_index(struct Wordlist *list)
+{
+	size_t capacity = 1024, count = 0;
+	uint32_t *offsets = malloc(capacity * sizeof(*offsets));
+	const char *p = list->data, *end = list->data + list->size;
+
+	list->longest = 0;
+	while (offsets && p < end) {
+		const char *eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		const char *word = eol;
+		while (word > p && word[-1] != '\t')  // after the dice roll, if any
+			--word;
+		const char *stop = eol > word && eol[-1] == '\r' ? eol - 1 : eol;
+		if (stop > word) {
+			if (count == capacity) {
+				uint32_t *grown = count < UINT32_MAX / 2 ? realloc(offsets, 2 * capacity * sizeof(*offsets)) : NULL;
+				if (!grown) {
+					free(offsets);
+					offsets = NULL;
+					break;
+				}
+				offsets = grown;
+				capacity *= 2;
+			}
+			offsets[count++] = word - list->data;
+			if ((size_t)(stop - word) > list->longest)
+				list->longest = stop - word;
+		}
+		p = eol + 1;
+	}
+	if (!offsets)
+		return -1;
+	if (count == 0) {
+		free(offsets);
+		errno = EINVAL;
+		return -1;
+	}
+	list->offsets = offsets;
+	list->count = count;
+	list->index = offsets;
+	list->index_size = 0;
+
+	return 0;
+}
+
+int wordlist_open(struct Wordlist *list, const char *path)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	if (st.st_size == 0 || (uint64_t)st.st_size > UINT32_MAX) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	int err = errno;
+	close(fd);  // the mapping stays
+	if (map == MAP_FAILED) {
+		errno = err;
+		return -1;
+	}
+	list->data = map;
+	list->size = st.st_size;
+
+	if (map_index(list, path, &st) != 0 && build_index(list) != 0) {
+		err = errno;
+		munmap(map, st.st_size);
+		errno = err;
+		return -1;
+	}
+	debug_print("%u words in %s, index %s", (unsigned)list->count, path, list->index_size ? "mapped" : "built");
+
+	return 0;
+}
+
+int wordlist_write_index(const struct Wordlist *list, const char *path)
+{
+	struct IndexHeader h = { INDEX_MAGIC, list->count, list->size, list->longest };
+	char *name = index_path(path);
+	if (!name)
+		return -1;
+
+	// write a temporary file and rename it, so that readers never see half an index
+	char *tmp = malloc(strlen(name) + 2);
+	int fd = -1;
+	if (tmp) {
+		strcpy(tmp, name);
+		strcat(tmp, "~");
+		fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	Output out = { fd, NULL, 0, 0, NULL };
+	int status = fd < 0 ? -1 : output_write(&out, (const char *)&h, sizeof(h));
+	if (status == 0)
+		status = output_write(&out, (const char *)list->offsets, list->count * sizeof(*list->offsets));
+	if (fd >= 0 && close(fd) != 0)
+		status = -1;
+	if (status == 0)
+		status = rename(tmp, name);
+	int err = errno;
+	if (status != 0 && fd >= 0)
+		unlink(tmp);
+	free(tmp);
+	free(name);
+	errno = err;
+
+	return status;
+}
+
+void wordlist_close(struct Wordlist *list)
+{
+	if (list->index_size)
+		munmap(list->index, list->index_size);
+	else
+		free(list->index);
+	munmap((void *)list->data, list->size);
+	list->data = NULL;
+	list->offsets = NULL;
+	list->index = NULL;
+	list->size = list->index_size = 0;
+	list->count = 0;
+}
+
+int wordlist_run(const struct Wordlist *list, struct RandomState *rng, size_t words,
+                 uint64_t count, char separator, char terminator, struct Output *out)
+{
+	struct Sampler sampler;
+
+	assert(list->longest < out->size);
+	sampler_init(&sampler, list->count);
+	for (uint64_t n = 0; count == 0 || n < count; ++n) {
+		for (size_t w = 0; w < words; ++w) {
+			const char *word;
+			size_t len = wordlist_word(list, sampler_draw(&sampler, rng), &word);
+			char *p = output_reserve(out, len + 1);
+			if (!p)
+				return -1;
+			memcpy(p, word, len);
+			p[len] = w + 1 < words ? separator : terminator;
+		}
+	}
+
+	return output_flush(out);
+}
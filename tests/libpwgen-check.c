@@ -0,0 +1,121 @@
+/*  pwgen-libcheck - checks of the library interface of pwgen
+ *  Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pwgen.h"
+
+#define PROGRAM_NAME "pwgen-libcheck"
+
+#define COUNT 256  // passwords drawn before and after every switch
+#define LEN 16     // their length, long enough that a repeat is no accident
+
+static int failures;
+
+static void pass(const char *what)
+{
+	printf("::: pass: %s\n", what);
+}
+
+static void fail(const char *what)
+{
+	printf("::: FAIL: %s\n", what);
+	failures++;
+}
+
+/* Return whether any of the n passwords at a is also among the n at b.
+ */
+static int repeats(const char *a, const char *b, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t j = 0; j < n; ++j) {
+			if (memcmp(a + i * (LEN + 1), b + j * (LEN + 1), LEN) == 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Draw passwords from ctx, switch it to each generator of rngs in turn, and
+ * check that the passwords drawn after every switch repeat none drawn before
+ * it; what names the check.
+ */
+static void check_switches(pwgen_ctx *ctx, const char *const *rngs, size_t n, const char *what)
+{
+	static char seen[8][COUNT * (LEN + 1)];
+
+	if (pwgen_fill(ctx, seen[0], COUNT, LEN) != 0) {
+		fail(what);
+		return;
+	}
+	for (size_t k = 1; k <= n; ++k) {
+		if (pwgen_set_rng(ctx, rngs[k - 1]) != 0 || pwgen_fill(ctx, seen[k], COUNT, LEN) != 0) {
+			fail(what);
+			return;
+		}
+		for (size_t i = 0; i < k; ++i) {
+			if (repeats(seen[i], seen[k], COUNT)) {
+				fail(what);
+				return;
+			}
+		}
+	}
+	pass(what);
+}
+
+int main(void)
+{
+	static const char *const same[] = { "chacha20", "chacha20", "chacha20" };
+	static const char *const mixed[] = { "xoshiro", "chacha20", "xoshiro", "chacha20" };
+	static const unsigned char key[32] = "pwgen-libcheck";
+	char first[COUNT * (LEN + 1)], again[COUNT * (LEN + 1)];
+
+	pwgen_ctx *ctx = pwgen_new();
+	if (!ctx) {
+		perror(PROGRAM_NAME);
+		return EXIT_FAILURE;
+	}
+
+	pwgen_seed(ctx, key, sizeof(key));
+	check_switches(ctx, same, sizeof(same) / sizeof(*same), "pwgen_set_rng to the same generator does not repeat passwords");
+	pwgen_seed(ctx, key, sizeof(key));
+	check_switches(ctx, mixed, sizeof(mixed) / sizeof(*mixed), "pwgen_set_rng back and forth does not repeat passwords");
+	pwgen_free(ctx);
+
+	// switches still give the same passwords from the same seed
+	const char *what = "pwgen_set_rng is reproducible from a seed";
+	for (int round = 0; round < 2; ++round) {
+		ctx = pwgen_new();
+		if (!ctx) {
+			perror(PROGRAM_NAME);
+			return EXIT_FAILURE;
+		}
+		pwgen_seed(ctx, key, sizeof(key));
+		pwgen_set_rng(ctx, "xoshiro");
+		pwgen_set_rng(ctx, "chacha20");
+		pwgen_fill(ctx, round ? again : first, COUNT, LEN);
+		pwgen_free(ctx);
+	}
+	if (memcmp(first, again, sizeof(first)) == 0)
+		pass(what);
+	else
+		fail(what);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
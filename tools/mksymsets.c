@@ -0,0 +1,170 @@
+/*  mksymsets - generate the predefined symbol set table of pwgen
+ *  Copyright (C) 2005-2020 Juho Rosqvist
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* This program is run by the build to write the C source of the predefined
+ * symbol set table and its perfect hash into standard output. Defining the
+ * sets here by ASCII character ranges automates the string length
+ * calculations, which should eliminate some pesky errors in case one
+ * modifies these character sets.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gensyms.h"
+
+#define MAX_SETS 64
+#define MAX_SYMBOLS 256
+
+struct Definition { // a symbol set built from ASCII ranges and earlier sets
+	const char *name;
+	const char *parts;  // pairs of characters (first and last of a range), or
+	                    // "=name" to include an earlier set; separated by ','
+};
+
+// in the order they are listed in the usage help
+static const struct Definition definitions[] = {
+	{ "asciip",   " ~" },       // printable ASCII characters, including space (32--126)
+	{ "asciipns", "!~" },       // printable ASCII characters, without space (33--126)
+	{ "num",      "09" },       // numbers 0-9 (ASCII 48--57)
+	{ "ALPHA",    "AZ" },       // uppercase letters (65--90)
+	{ "alpha",    "az" },       // lowercase letters (97--122)
+	{ "Alpha",    "=ALPHA,=alpha" },  // all letters
+	{ "ALNUM",    "=ALPHA,=num" },    // uppercase alphanumeric characters
+	{ "alnum",    "=alpha,=num" },    // lowercase alphanumeric characters
+	{ "Alnum",    "=Alpha,=num" },    // uppercase & lowercase alphanumeric characters
+	{ "punct",    "!/,:@,[`,{~" },    // punctuation characters (33--47, 58--64, 91--96, 123--126)
+};
+#define NSETS (sizeof(definitions) / sizeof(*definitions))
+
+static char symbols[NSETS][MAX_SYMBOLS];
+static size_t sizes[NSETS];
+
+/* Replace characters from the start of the string dest with the ASCII values
+ * between characters first and last (inclusive).
+ * Return the number of characters replaced (i.e. #last - #first + 1).
+ */
+static size_t fill_ascii_range(char *dest, char first, char last)
+{
+	int i;
+
+	for (i = 0; first + i <= last; ++i)
+		dest[i] = first + i;
+	assert(last - first + 1 == i);
+
+	return i;
+}
+
+/* Build the symbols of definitions[n] from its parts.
+ */
+static void build(size_t n)
+{
+	const char *p = definitions[n].parts;
+	size_t len = 0;
+
+	while (*p) {
+		if (*p == '=') {
+			size_t name_len = strcspn(p + 1, ",");
+			size_t k;
+			for (k = 0; k < n; ++k) {
+				if (strlen(definitions[k].name) == name_len
+				    && strncmp(definitions[k].name, p + 1, name_len) == 0)
+					break;
+			}
+			if (k == n) {
+				fprintf(stderr, "mksymsets: %s: no earlier set %.*s\n", definitions[n].name, (int)name_len, p + 1);
+				exit(EXIT_FAILURE);
+			}
+			assert(len + sizes[k] < MAX_SYMBOLS);
+			memcpy(symbols[n] + len, symbols[k], sizes[k]);
+			len += sizes[k];
+			p += 1 + name_len;
+		}
+		else {
+			assert(p[1] && len + (unsigned char)p[1] - (unsigned char)p[0] + 1 < MAX_SYMBOLS);
+			len += fill_ascii_range(symbols[n] + len, p[0], p[1]);
+			p += 2;
+		}
+		if (*p == ',')
+			++p;
+	}
+	sizes[n] = len;
+}
+
+/* Print s as a C string literal.
+ */
+static void print_literal(const char *s, size_t len)
+{
+	putchar('"');
+	for (size_t i = 0; i < len; ++i) {
+		if (s[i] == '"' || s[i] == '\\')
+			putchar('\\');
+		if (s[i] == '?')  // avoid trigraphs
+			printf("\\?");
+		else
+			putchar(s[i]);
+	}
+	putchar('"');
+}
+
+int main(void)
+{
+	int slots[MAX_SETS];
+	size_t hash_size = 1;
+	uint32_t seed;
+
+	for (size_t n = 0; n < NSETS; ++n)
+		build(n);
+
+	// find the smallest power-of-two table (at least 1.5 slots per set) and a
+	// seed that puts every name into its own slot
+	while (hash_size < NSETS + NSETS / 2)
+		hash_size *= 2;
+	assert(hash_size <= MAX_SETS);
+	for (seed = 0; ; ++seed) {
+		size_t n;
+		for (size_t i = 0; i < hash_size; ++i)
+			slots[i] = -1;
+		for (n = 0; n < NSETS; ++n) {
+			uint32_t h = symbol_set_hash(definitions[n].name, seed) & (hash_size - 1);
+			if (slots[h] >= 0)
+				break;
+			slots[h] = n;
+		}
+		if (n == NSETS)
+			break;
+	}
+
+	printf("/* Generated by tools/mksymsets.c; do not edit. */\n\n");
+	printf("#define SYMBOL_SET_HASH_SEED %#xu\n", (unsigned)seed);
+	printf("#define SYMBOL_SET_HASH_SIZE %zu\n\n", hash_size);
+	printf("const struct SymbolSet predefined_sets[] = {\n");
+	for (size_t n = 0; n < NSETS; ++n) {
+		printf("\t{ \"%s\", ", definitions[n].name);
+		print_literal(symbols[n], sizes[n]);
+		printf(", %zu },\n", sizes[n]);
+	}
+	printf("\t{ NULL, NULL, 0 }\n};\n\n");
+	printf("static const signed char symbol_set_slots[SYMBOL_SET_HASH_SIZE] = {");
+	for (size_t i = 0; i < hash_size; ++i)
+		printf("%s%d", i ? ", " : " ", slots[i]);
+	printf(" };\n");
+
+	return EXIT_SUCCESS;
+}